@@ -4,12 +4,24 @@
 #pragma once
 
 #include <boost/predef.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
 #include <boost/filesystem.hpp>
 
+#if !BOOST_OS_WINDOWS
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace tipi::goldilock::file {
   using namespace std::string_literals;
   namespace fs = boost::filesystem;
@@ -59,4 +71,151 @@ namespace tipi::goldilock::file {
     
     ofs.close();
   }
-}
\ No newline at end of file
+
+  //!\brief write content to path (chmod-ed like touch_file_permissive()) so that readers either see all of it or no file at all
+  inline void write_file_permissive(const boost::filesystem::path& path, const std::string& content) {
+    fs::path staging = path.parent_path() / (path.filename().generic_string() + "."s + fs::unique_path().generic_string() + ".tmp"s);
+
+    {
+      std::ofstream ofs(staging.generic_string(), std::ios::out | std::ios::trunc | std::ios::binary);
+      ofs << content;
+    }
+
+    boost::system::error_code ec;
+    fs::permissions(staging, fs::add_perms|fs::owner_write|fs::group_write|fs::others_write, ec);
+    fs::rename(staging, path);
+  }
+
+  //!\brief create a directory that multiple users can share (chmod-ed 777 like touch_file_permissive() does for files)
+  inline void create_directory_permissive(const boost::filesystem::path& path) {
+    boost::system::error_code ec;
+    if(fs::create_directory(path, ec)) {
+      fs::permissions(path, fs::add_perms|fs::owner_all|fs::group_all|fs::others_all, ec);
+    }
+  }
+
+  //!\brief what a single stat() tells about a file
+  struct file_status {
+    std::chrono::system_clock::time_point last_write_time;
+
+    //!\brief device and inode, to tell apart files recreated under the same name (0 where unsupported)
+    uint64_t device = 0;
+    uint64_t inode = 0;
+  };
+
+  //!\brief status of path (sub-second modification time where the platform has it), std::nullopt if path doesn't exist
+  inline std::optional<file_status> get_file_status(const boost::filesystem::path& path) {
+    file_status result;
+
+    #if BOOST_OS_WINDOWS
+    boost::system::error_code ec;
+    std::time_t mtime = fs::last_write_time(path, ec);
+    if(ec) {
+      return std::nullopt;
+    }
+    result.last_write_time = std::chrono::system_clock::from_time_t(mtime);
+    #else
+    struct stat st;
+    if(::stat(path.c_str(), &st) != 0) {
+      return std::nullopt;
+    }
+
+    #if BOOST_OS_MACOS
+    const auto& mtime = st.st_mtimespec;
+    #else
+    const auto& mtime = st.st_mtim;
+    #endif
+
+    auto since_epoch = std::chrono::seconds(mtime.tv_sec) + std::chrono::nanoseconds(mtime.tv_nsec);
+    result.last_write_time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+    result.device = static_cast<uint64_t>(st.st_dev);
+    result.inode = static_cast<uint64_t>(st.st_ino);
+    #endif
+
+    return result;
+  }
+
+  //!\brief modification time of path (sub-second where the platform has it), std::nullopt if path doesn't exist
+  inline std::optional<std::chrono::system_clock::time_point> get_last_write_time(const boost::filesystem::path& path) {
+    auto status = get_file_status(path);
+    if(!status) {
+      return std::nullopt;
+    }
+    return status->last_write_time;
+  }
+
+  //!\brief set the modification time of path without touching its contents, false if that failed (e.g. path doesn't exist)
+  inline bool set_last_write_time(const boost::filesystem::path& path, std::chrono::system_clock::time_point time) {
+    #if BOOST_OS_WINDOWS
+    boost::system::error_code ec;
+    fs::last_write_time(path, std::chrono::system_clock::to_time_t(time), ec);
+    return !ec;
+    #else
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch());
+
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;  // leave atime alone
+    times[1].tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+    times[1].tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+
+    return ::utimensat(AT_FDCWD, path.c_str(), times, 0) == 0;
+    #endif
+  }
+
+  #if !BOOST_OS_WINDOWS
+  //!\brief set_last_write_time() through an open file descriptor, false if that failed or if the
+  //! file got removed in the meantime (so the caller knows its file isn't reachable anymore)
+  inline bool set_last_write_time(int fd, std::chrono::system_clock::time_point time) {
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch());
+
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;  // leave atime alone
+    times[1].tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+    times[1].tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+
+    struct stat st;
+    return ::futimens(fd, times) == 0 && ::fstat(fd, &st) == 0 && st.st_nlink > 0;
+  }
+
+  //!\brief an exclusive flock() held on a file for as long as this object lives - and never longer
+  //! than the process holding it, the kernel releases it however that process ends (SIGKILL included)
+  struct flock_guard {
+    explicit flock_guard(int fd) : fd_{fd} {}
+
+    ~flock_guard() {
+      ::close(fd_);
+    }
+
+    flock_guard(const flock_guard&) = delete;
+    flock_guard& operator=(const flock_guard&) = delete;
+
+    int native_handle() const {
+      return fd_;
+    }
+
+  private:
+    int fd_;
+  };
+
+  //!\brief open (or create) path and flock() it exclusively, waiting for concurrent probes to let go
+  //!\return nullptr if the file or the filesystem doesn't allow it
+  inline std::shared_ptr<flock_guard> lock_file_exclusively(const boost::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if(fd < 0) {
+      return nullptr;
+    }
+
+    int ret = 0;
+    while((ret = ::flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+
+    if(ret != 0) {
+      ::close(fd);
+      return nullptr;
+    }
+
+    return std::make_shared<flock_guard>(fd);
+  }
+  #endif
+}
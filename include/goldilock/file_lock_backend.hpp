@@ -0,0 +1,773 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <goldilock/file.hpp>
+#include <goldilock/goldilock_spot.hpp>
+#include <goldilock/hold_time_estimate.hpp>
+#include <goldilock/lock_backend.hpp>
+#include <goldilock/lockfile_semaphore.hpp>
+#include <goldilock/queue_watcher.hpp>
+#include <goldilock/random.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::string_literals;
+  using namespace std::chrono_literals;
+
+  //!\brief the queue of spots next to the lockfiles plus the lock on the lockfiles themselves (goldilock --backend file)
+  //!
+  //! Every goldilock takes a spot in line for each lockfile (cf. goldilock_spot) and once first in all
+  //! the lines waits for the locks on the lockfiles (cf. lockfile_lock). This works between hosts
+  //! sharing the filesystem. Locks that are free while nobody waits in line are taken right away.
+  //! With --slots the first few in line hold the locks at the same time as long as the tokens they
+  //! need fit into the capacity, cf. lockfile_semaphore. With --shared the consecutive shared spots
+  //! at the head of the queue hold the locks together. With --any-of we wait in all the lines and
+  //! take whichever lock we get first, leaving the other lines right away. Several locks are taken
+  //! according to the multi_lock_strategy. Holders record how long they held the locks, so that
+  //! goldilocks can refuse to get in line when the wait would be too long, cf. check_admission().
+  struct file_lock_backend : lock_backend {
+
+    file_lock_backend(const lock_backend_options& options, std::ostream& log)
+      : options_{options}
+      , log_{log}
+      , ordered_lockfiles_{options.lockfiles}
+    {
+      std::sort(ordered_lockfiles_.begin(), ordered_lockfiles_.end());
+      ordered_lockfiles_.erase(std::unique(ordered_lockfiles_.begin(), ordered_lockfiles_.end()), ordered_lockfiles_.end());
+    }
+
+    ~file_lock_backend() override {
+      release();
+    }
+
+    void enqueue() override {
+      check_admission();
+
+      enqueued_ = true;
+
+      // kept when getting back in line, cf. goldilock_spot::has_older_multi_lock_ahead()
+      if(request_timestamp_ == 0) {
+        request_timestamp_ = to_unix_ms(std::chrono::system_clock::now());
+      }
+
+      // with slots the holders' spots count against the capacity of the locks, everyone gets in line
+      if(options_.slots == 1) {
+        acquired_ = options_.any_of ? try_acquire_any_uncontended() : try_acquire_uncontended();
+      }
+
+      if(acquired_) {
+        acquired_at_ = std::chrono::steady_clock::now();
+        log_ << "(fast path) no contention, acquired all locks without getting in line" << std::endl;
+      }
+      else if(is_ordered()) {
+        take_lock_spot(ordered_lockfiles_.front());
+      }
+      else {
+        take_lock_spots();
+      }
+    }
+
+    bool acquire_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) override {
+      if(!enqueued_) {
+        enqueue();
+      }
+
+      if(acquired_) {
+        return true;
+      }
+
+      // far back in line: not worth looking at the lines yet, cf. wait_in_line()
+      if(!wait_for_next_look(deadline)) {
+        return false;
+      }
+
+      if(options_.any_of) {
+        acquire_any_until(deadline, cancel);
+      }
+      else if(is_ordered()) {
+        acquire_in_order_until(deadline, cancel);
+      }
+      else {
+        acquire_all_until(deadline, cancel);
+      }
+
+      if(acquired_) {
+        acquired_at_ = std::chrono::steady_clock::now();
+      }
+
+      return acquired_;
+    }
+
+    void heartbeat() override {
+      boost::mutex::scoped_lock scoped_lock(spots_mut_);
+      for(auto& [target, spot] : spots_) {
+        spot.update_spot();
+      }
+    }
+
+    std::optional<std::chrono::milliseconds> heartbeat_interval() const override {
+      return options_.heartbeat;
+    }
+
+    std::optional<fs::path> get_chosen_lockfile() const override {
+      return chosen_lockfile_;
+    }
+
+    void release() override {
+      std::vector<fs::path> held_lockfiles;
+      std::optional<std::chrono::milliseconds> hold_time;
+      if(acquired_ && acquired_at_.has_value()) {
+        hold_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - acquired_at_.value());
+        for(const auto& [lockfile, lock] : file_locks_) {
+          held_lockfiles.push_back(lockfile);
+        }
+      }
+
+      // the locks before our spots: whoever is next in line only goes for the locks once our spots are gone
+      file_locks_.clear();
+
+      {
+        boost::mutex::scoped_lock scoped_lock(spots_mut_);
+        spots_.clear();
+      }
+
+      // best effort and a few file accesses per lockfile: not while the next in line waits for us
+      if(hold_time.has_value()) {
+        record_hold_time(held_lockfiles, hold_time.value());
+      }
+
+      acquired_ = false;
+      enqueued_ = false;
+      acquired_at_.reset();
+      chosen_lockfile_.reset();
+      next_ordered_lock_ = 0;
+      request_timestamp_ = 0;
+      turns_ahead_.reset();
+      spots_ahead_counted_.clear();
+      poll_interval_ = min_poll_interval;
+      next_look_.reset();
+    }
+
+  private:
+
+    //!\brief acquire_until() waiting to be first in all the lines, then taking all the locks at once (--multi-lock-strategy reshuffle)
+    bool acquire_all_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) {
+      while(!acquired_ && !cancel) {
+
+        size_t count_first_in_line = 0;
+        size_t count_spots = 0;
+        {
+          // the heartbeat may put a spot back in line meanwhile, cf. goldilock_spot::update_spot()
+          boost::mutex::scoped_lock scoped_lock(spots_mut_);
+          count_spots = spots_.size();
+          count_first_in_line = std::count_if(
+            spots_.begin(),
+            spots_.end(),
+            [this](const auto& pair) {
+              return is_eligible(pair.second);
+            });
+        }
+
+        bool all_first_in_line = count_first_in_line == count_spots;
+        bool some_first_in_line = count_first_in_line > 0;
+
+        // at the head of every queue (or close enough with slots): wait for the holders in the kernel, so that we get the locks the
+        // moment they are released (bounded, so that we don't wait on a partial lock forever)
+        auto lock_deadline = std::min(deadline, std::chrono::steady_clock::now() + 500ms);
+
+        if(all_first_in_line) {
+          std::vector<lockfile_semaphore *> acquired_locks;
+
+          for(auto &[path, lock] : file_locks_) {
+            if(!lock.lock_until(lock_deadline, cancel)) {
+              break;
+            }
+            acquired_locks.push_back(&lock);
+          }
+
+          acquired_ = acquired_locks.size() == file_locks_.size();
+
+          // all or nothing, our places at the head of the lines keep the others waiting anyway
+          if(!acquired_) {
+            for(auto lock : acquired_locks) {
+              lock->unlock();
+            }
+          }
+        }
+
+        if(some_first_in_line && !acquired_){
+          failed_all_locks_acquire_++;
+        }
+
+        // if we didn't manage to aquire the locks a given of times in a row, let's get back line
+        // so we don't deadlock - unless no multi-lock request we have to give way to waits ahead of us:
+        // then we keep our place, so that the oldest multi-lock request can't be starved by later ones
+        if(failed_all_locks_acquire_ > failed_all_locks_acquire_limit_) {
+          failed_all_locks_acquire_ = 0;
+          failed_all_locks_acquire_limit_ = random::random_in_range(5, 20);
+
+          if(!has_to_give_way()) {
+            log_ << "(aquiring all locks) keeping our place in line, no older multi-lock request waits ahead of us" << std::endl;
+          }
+          else {
+            {
+              boost::mutex::scoped_lock scoped_lock(spots_mut_);
+              spots_.clear();  // really clear our lock spots here so we don't lock up a spot
+            }
+
+            // back of being in the queue for some random amount of time so others can process, even if everyone was started at the same time
+            auto rand_sleep_duration = random::random_sleep_duration<>(200ms, 2000ms);
+            log_ << "(aquiring all locks) lock acquisition has failed repeatedly pausing for " << rand_sleep_duration.count() << "ms before getting back in line" << std::endl;
+            std::this_thread::sleep_for(rand_sleep_duration);
+
+            turns_ahead_.reset();
+            spots_ahead_counted_.clear();
+            take_lock_spots();
+          }
+        }
+
+        if(acquired_) {
+          break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if(now >= deadline) {
+          break;
+        }
+
+        // waited for the locks already
+        if(all_first_in_line && now >= lock_deadline) {
+          continue;
+        }
+
+        // wait for the queues to move, when at the head of some queue keep polling though as
+        // releasing the actual file lock doesn't produce any event we could wait for
+        if(some_first_in_line) {
+          watcher_.wait_for_change(std::min(min_poll_interval, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + 1ms));
+        }
+        else {
+          wait_in_line(deadline);
+        }
+      }
+
+      return acquired_;
+    }
+
+    //!\brief don't add to the pile-up when a line is too long already (goldilock --max-queue-depth / --max-expected-wait)
+    //!\throw lock_admission_error when we shouldn't get in line, with --any-of only if that's true of every line
+    void check_admission() const {
+      if(!options_.max_queue_depth.has_value() && !options_.max_expected_wait.has_value()) {
+        return;
+      }
+
+      std::vector<std::string> rejections;
+      for(const auto& lockfile : options_.lockfiles) {
+        if(auto rejection = get_admission_rejection(lockfile); rejection.has_value()) {
+          rejections.push_back(rejection.value());
+        }
+      }
+
+      bool admitted = options_.any_of ? (rejections.size() < options_.lockfiles.size()) : rejections.empty();
+      if(!admitted) {
+        throw lock_admission_error(rejections.front());
+      }
+    }
+
+    //!\brief why we shouldn't get in line for lockfile, if so
+    //!
+    //! The wait to expect is the recorded hold time of the lock for each spot in line (holders
+    //! included with --slots or --shared) divided by the number of slots, the time left to whoever
+    //! holds the lock without a spot (taken on the fast path) isn't known.
+    std::optional<std::string> get_admission_rejection(const fs::path& lockfile) const {
+      if(!fs::exists(lockfile)) {
+        return std::nullopt;
+      }
+
+      size_t depth = list_lockfile_spots(lockfile).size();
+
+      if(options_.max_queue_depth.has_value() && depth >= options_.max_queue_depth.value()) {
+        return lockfile.generic_string() + " has "s + std::to_string(depth) + " goldilock(s) in line (--max-queue-depth "s
+          + std::to_string(options_.max_queue_depth.value()) + ")"s;
+      }
+
+      if(options_.max_expected_wait.has_value() && depth > 0) {
+        if(auto hold_time = hold_time_estimate::read(lockfile); hold_time.has_value()) {
+          auto expected_wait = std::chrono::milliseconds(hold_time->count() * static_cast<std::chrono::milliseconds::rep>(depth) / static_cast<std::chrono::milliseconds::rep>(options_.slots));
+
+          if(expected_wait > options_.max_expected_wait.value()) {
+            return lockfile.generic_string() + " is expected to take "s + std::to_string(expected_wait.count()) + "ms to get (--max-expected-wait "s
+              + std::to_string(options_.max_expected_wait->count()) + ")"s;
+          }
+        }
+      }
+
+      return std::nullopt;
+    }
+
+    //!\brief tell those about to get in line how long we held the locks, cf. hold_time_estimate (best effort)
+    void record_hold_time(const std::vector<fs::path>& lockfiles, std::chrono::milliseconds hold_time) const {
+      for(const auto& lockfile : lockfiles) {
+        try {
+          hold_time_estimate::record(lockfile, hold_time);
+        }
+        catch(const std::exception& exc) {
+          log_ << "(hold time) couldn't record the hold time of " << lockfile.generic_string() << ": " << exc.what() << std::endl;
+        }
+      }
+    }
+
+    bool is_ordered() const {
+      return !options_.any_of && options_.strategy == multi_lock_strategy::ordered && !ordered_lockfiles_.empty();
+    }
+
+    //!\brief acquire_until() taking the locks one after the other in the order of their canonical paths
+    //!
+    //! As everyone takes them in the same order, nobody holding a lock we wait for can be waiting for
+    //! one we hold: we keep what we got while waiting for the next one and never have to back off.
+    //! We only get in line for a lock once we hold all those before it, so that we don't hold up
+    //! anyone in lines we're not ready to take the lock of.
+    bool acquire_in_order_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) {
+      while(next_ordered_lock_ < ordered_lockfiles_.size() && !cancel) {
+        const auto& lockfile = ordered_lockfiles_[next_ordered_lock_];
+        take_lock_spot(lockfile);
+
+        bool eligible = false;
+        {
+          boost::mutex::scoped_lock scoped_lock(spots_mut_);
+          eligible = is_eligible(spots_.at(lockfile));
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        if(eligible) {
+          if(file_locks_.at(lockfile).lock_until(std::min(deadline, now + 500ms), cancel)) {
+            log_ << "(ordered) acquired " << lockfile.generic_string() << std::endl;
+            next_ordered_lock_++;
+            turns_ahead_.reset();  // a new line
+            spots_ahead_counted_.clear();
+            continue;
+          }
+        }
+        else {
+          wait_in_line(deadline);
+        }
+
+        if(std::chrono::steady_clock::now() >= deadline) {
+          break;
+        }
+      }
+
+      acquired_ = (next_ordered_lock_ == ordered_lockfiles_.size());
+      return acquired_;
+    }
+
+    //!\brief whether a multi-lock request we have to give way to waits ahead of us in one of our lines
+    bool has_to_give_way() const {
+      boost::mutex::scoped_lock scoped_lock(spots_mut_);
+      return std::any_of(spots_.begin(), spots_.end(), [](const auto& pair) { return pair.second.has_older_multi_lock_ahead(); });
+    }
+
+    //!\brief wait for the lines to move, the further back we are the less often we look
+    //!
+    //! Close to the head (within the next near_head_turns rounds of holders, a round being --slots of
+    //! them) we wake up on every change of the lines, or every min_poll_interval when the filesystem
+    //! doesn't deliver events or when we wait for the current holders: their owners dying leaves their
+    //! spots behind without any event, we only find out by probing them. Further back we don't look at the lines again before enough of those
+    //! ahead of us left to bring us close to the head (as told by the queue_watcher), or without events
+    //! before they may have according to their recorded hold times (cf. hold_time_estimate). Either
+    //! way we look again after an interval doubling for as long as we don't move up (up to
+    //! max_poll_interval, jittered so that the waiters don't all look at once). Such a wait may last
+    //! beyond deadline, acquire_until() only looks again once it's over.
+    void wait_in_line(std::chrono::steady_clock::time_point deadline) {
+      auto now = std::chrono::steady_clock::now();
+      if(now >= deadline) {
+        return;
+      }
+
+      // once close to the head we stay there (unless a newcomer with a higher priority passes us, hardly worth a scan)
+      bool near_head = turns_ahead_.has_value() && turns_ahead_.value() <= near_head_turns;
+
+      size_t turns_ahead = near_head ? turns_ahead_.value() : estimate_turns_ahead();
+
+      if(turns_ahead <= near_head_turns) {
+        turns_ahead_ = turns_ahead;
+
+        std::chrono::milliseconds wait_interval = (watcher_.is_event_driven() && turns_ahead > 1) ? 1000ms : min_poll_interval;
+        watcher_.wait_for_change(std::min(wait_interval, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + 1ms));
+        return;
+      }
+
+      departures_to_near_head_ = (turns_ahead - near_head_turns) * options_.slots;
+      departures_ = 0;
+
+      // possibly beyond the deadline: the next calls of acquire_until() keep waiting then
+      next_look_ = now + get_poll_interval(turns_ahead);
+      wait_for_next_look(deadline);
+    }
+
+    //!\brief wait until it's time to look at the lines again (cf. wait_in_line()) or the deadline passed
+    //!\return true if it's time
+    bool wait_for_next_look(std::chrono::steady_clock::time_point deadline) {
+      if(!next_look_.has_value()) {
+        return true;
+      }
+
+      auto until = std::min(next_look_.value(), deadline);
+      auto now = std::chrono::steady_clock::now();
+
+      // only the departures matter, but the events mustn't pile up in the watcher anyway
+      while(now < until && departures_ < departures_to_near_head_) {
+        watcher_.wait_for_change(std::chrono::duration_cast<std::chrono::milliseconds>(until - now) + 1ms);
+        size_t departed = take_departures();
+        departures_ = saturating_add(departures_, departed);
+        now = std::chrono::steady_clock::now();
+      }
+
+      if(now < next_look_.value() && departures_ < departures_to_near_head_) {
+        return false;
+      }
+
+      next_look_.reset();
+      return true;
+    }
+
+    //!\brief how long to wait at most before looking at the lines again with turns_ahead rounds of holders ahead of us
+    std::chrono::milliseconds get_poll_interval(size_t turns_ahead) {
+      // back off with every look, unless we have to poll: start over once we moved up then
+      if(turns_ahead_.has_value()) {
+        bool moved_up = turns_ahead < turns_ahead_.value();
+        poll_interval_ = (moved_up && !watcher_.is_event_driven()) ? min_poll_interval : std::min(poll_interval_ * 2, max_poll_interval);
+      }
+      turns_ahead_ = turns_ahead;
+
+      auto interval = poll_interval_;
+
+      // nobody tells us when those ahead of us leave: don't sleep past our turn when they are quick (half way only,
+      // sleeping at the head of the line would hold up everyone behind us)
+      if(!watcher_.is_event_driven()) {
+        if(auto hold_time = get_shortest_hold_time(); hold_time.has_value()) {
+          auto time_to_near_head = hold_time.value() * static_cast<std::chrono::milliseconds::rep>(turns_ahead - near_head_turns);
+          interval = std::min(interval, std::max(min_poll_interval, time_to_near_head / 2));
+        }
+      }
+
+      return random::random_sleep_duration(interval / 2, interval);
+    }
+
+    //!\brief how many rounds of holders are at most ahead of us in the furthest of our lines (the closest with --any-of)
+    //!
+    //! The lines are only counted once (cf. goldilock_spot::count_spots_ahead()), after that whoever left the
+    //! watched queues since is taken to have been ahead of us, or without events as many as the recorded hold
+    //! times allow for (we count again if none were recorded yet). So we may look too soon but never too late.
+    size_t estimate_turns_ahead() {
+      boost::mutex::scoped_lock scoped_lock(spots_mut_);
+
+      auto now = std::chrono::steady_clock::now();
+      take_departures();
+      size_t departed = departed_since_count_;
+      std::optional<std::chrono::milliseconds> hold_time;
+
+      if(!watcher_.is_event_driven()) {
+        hold_time = get_shortest_hold_time();
+        departed = hold_time.has_value() ? static_cast<size_t>((now - counted_at_) / std::max(hold_time.value(), 1ms)) * options_.slots : 0;
+      }
+
+      if(spots_ahead_counted_.empty() || (!watcher_.is_event_driven() && !hold_time.has_value())) {
+        spots_ahead_counted_.clear();
+        for(const auto& [lockfile, spot] : spots_) {
+          if(is_current_line(lockfile)) {
+            spots_ahead_counted_[lockfile] = spot.count_spots_ahead();
+          }
+        }
+
+        departed = 0;
+        counted_at_ = now;
+      }
+
+      departed_since_count_ = departed;
+
+      std::optional<size_t> turns_ahead;
+      for(const auto& [lockfile, spots_ahead] : spots_ahead_counted_) {
+        size_t line_turns = (spots_ahead - std::min(spots_ahead, departed)) / options_.slots;
+
+        if(!turns_ahead.has_value()) {
+          turns_ahead = line_turns;
+        }
+        else {
+          turns_ahead = options_.any_of ? std::min(turns_ahead.value(), line_turns) : std::max(turns_ahead.value(), line_turns);
+        }
+      }
+
+      return turns_ahead.value_or(0);
+    }
+
+    //!\brief whether we wait in the line of lockfile at the moment, taking the locks in order that's only the next one's
+    bool is_current_line(const fs::path& lockfile) const {
+      return !is_ordered() || lockfile == ordered_lockfiles_[std::min(next_ordered_lock_, ordered_lockfiles_.size() - 1)];
+    }
+
+    //!\brief the spots that left the watched queues since we last asked, cf. estimate_turns_ahead()
+    size_t take_departures() {
+      size_t departed = watcher_.take_departures();
+      departed_since_count_ = saturating_add(departed_since_count_, departed);
+      return departed;
+    }
+
+    static size_t saturating_add(size_t a, size_t b) {
+      return (b > std::numeric_limits<size_t>::max() - a) ? std::numeric_limits<size_t>::max() : a + b;
+    }
+
+    //!\brief the recorded hold time of the quickest of our locks, if any
+    std::optional<std::chrono::milliseconds> get_shortest_hold_time() const {
+      std::optional<std::chrono::milliseconds> shortest;
+
+      for(const auto& [lockfile, lock] : file_locks_) {
+        auto hold_time = hold_time_estimate::read(lockfile);
+
+        if(hold_time.has_value() && (!shortest.has_value() || hold_time.value() < shortest.value())) {
+          shortest = hold_time;
+        }
+      }
+
+      return shortest;
+    }
+
+    //!\brief whether spot is far enough ahead in its line to go for the lock
+    bool is_eligible(const goldilock_spot& spot) const {
+      return options_.shared ? spot.is_among_shared_at_head() : spot.is_within_capacity(options_.slots);
+    }
+
+    //!\brief acquire_until() for --any-of: no partial locks to back off from, we only ever hold one
+    bool acquire_any_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) {
+      for(size_t attempt = 0; !acquired_ && !cancel; attempt++) {
+        std::vector<fs::path> eligible;
+        {
+          boost::mutex::scoped_lock scoped_lock(spots_mut_);
+          for(const auto& [lockfile, spot] : spots_) {
+            if(is_eligible(spot)) {
+              eligible.push_back(lockfile);
+            }
+          }
+        }
+
+        for(const auto& lockfile : eligible) {
+          if(file_locks_.at(lockfile).try_lock()) {
+            choose_lockfile(lockfile);
+            return true;
+          }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if(now >= deadline) {
+          break;
+        }
+
+        // wait in the kernel for one of the locks we're up for (taking turns), or for the lines to move
+        if(!eligible.empty()) {
+          const auto& lockfile = eligible[attempt % eligible.size()];
+          if(file_locks_.at(lockfile).lock_until(std::min(deadline, now + 100ms), cancel)) {
+            choose_lockfile(lockfile);
+            return true;
+          }
+        }
+        else {
+          wait_in_line(deadline);
+        }
+      }
+
+      return acquired_;
+    }
+
+    //!\brief we hold the lock on lockfile: leave all the other lines
+    void choose_lockfile(const fs::path& lockfile) {
+      {
+        boost::mutex::scoped_lock scoped_lock(spots_mut_);
+        for(auto it = spots_.begin(); it != spots_.end();) {
+          it = (it->first == lockfile) ? std::next(it) : spots_.erase(it);
+        }
+      }
+
+      for(auto it = file_locks_.begin(); it != file_locks_.end();) {
+        it = (it->first == lockfile) ? std::next(it) : file_locks_.erase(it);
+      }
+
+      chosen_lockfile_ = lockfile;
+      acquired_ = true;
+      log_ << "(any of) acquired " << lockfile.generic_string() << std::endl;
+    }
+
+    void prepare_queue_directory(const fs::path& lockfile) {
+      if(options_.use_queue_directory) {
+        file::create_directory_permissive(get_lockfile_dedicated_queue_directory(lockfile));
+      }
+    }
+
+    //!\brief make sure the lockfile exists and we have a lockfile_semaphore on it
+    lockfile_semaphore& get_file_lock(const fs::path& lockfile) {
+      auto it = file_locks_.find(lockfile);
+
+      if(it == file_locks_.end()) {
+        file::touch_file_permissive(lockfile.generic_string());
+        it = file_locks_.try_emplace(lockfile, lockfile, options_.slots, options_.tokens, options_.shared).first;
+      }
+
+      return it->second;
+    }
+
+    //!\brief take our spot in line for lockfile (unless we have one already) and ensure the actual lockfile is created
+    void take_lock_spot(const fs::path& lockfile) {
+      boost::mutex::scoped_lock scoped_lock(spots_mut_);
+
+      prepare_queue_directory(lockfile);
+
+      if(spots_.find(lockfile) == spots_.end()) {
+        goldilock_spot::owner_terms terms;
+        terms.lease_ms = static_cast<size_t>(options_.lease.count());
+        terms.tokens = options_.tokens;
+        terms.shared = options_.shared;
+        terms.priority = options_.priority;
+        terms.priority_aging_ms = static_cast<size_t>(options_.priority_aging.count());
+        terms.deadline = options_.deadline ? to_unix_ms(options_.deadline.value()) : 0;
+        terms.tenant = spot_record::get_tenant_key(options_.tenant);
+        terms.fair_share_weight = options_.fair_share_weight;
+        terms.multi_lock = !options_.any_of && ordered_lockfiles_.size() > 1;
+        // goldilocks taking the locks in order never give up their place, the others always give way to them
+        terms.request_timestamp = is_ordered() ? 0 : request_timestamp_;
+
+        spots_.try_emplace(lockfile, lockfile, terms);
+        watcher_.watch(lockfile);
+      }
+
+      get_file_lock(lockfile);
+    }
+
+    //!\brief take our spots in all the lines
+    void take_lock_spots() {
+      for(const auto& lockfile : options_.lockfiles) {
+        take_lock_spot(lockfile);
+      }
+    }
+
+    //!\brief uncontended fast path
+    //!
+    //! If the locks are free and nobody waits in line for them, take them right away without getting
+    //! in line at all. Whoever shows up after us gets in line and waits for the locks we hold like for
+    //! any other holder. Otherwise let go of what we got and wait in line fairly.
+    bool try_acquire_uncontended() {
+      std::vector<lockfile_semaphore *> acquired_locks;
+      bool uncontended = true;
+
+      for(const auto& lockfile : options_.lockfiles) {
+        prepare_queue_directory(lockfile);
+
+        auto& lock = get_file_lock(lockfile);
+
+        // lock first, then look at the queue: anyone getting in line after that has to wait for us
+        if(!lock.try_lock()) {
+          uncontended = false;
+          break;
+        }
+
+        acquired_locks.push_back(&lock);
+
+        if(!list_lockfile_spots(lockfile).empty()) {
+          uncontended = false;
+          break;
+        }
+      }
+
+      if(!uncontended) {
+        for(auto lock : acquired_locks) {
+          lock->unlock();
+        }
+      }
+
+      return uncontended;
+    }
+
+    //!\brief uncontended fast path for --any-of: the first lock that is free while nobody waits for it
+    bool try_acquire_any_uncontended() {
+      for(const auto& lockfile : options_.lockfiles) {
+        prepare_queue_directory(lockfile);
+
+        auto& lock = get_file_lock(lockfile);
+
+        if(!lock.try_lock()) {
+          continue;
+        }
+
+        if(list_lockfile_spots(lockfile).empty()) {
+          choose_lockfile(lockfile);
+          return true;
+        }
+
+        lock.unlock();
+      }
+
+      return false;
+    }
+
+    lock_backend_options options_;
+    std::ostream& log_;
+
+    bool enqueued_ = false;
+    bool acquired_ = false;
+    std::optional<fs::path> chosen_lockfile_;
+
+    //!\brief since when we hold the locks, cf. record_hold_time()
+    std::optional<std::chrono::steady_clock::time_point> acquired_at_;
+
+    //!\brief the lockfiles sorted by canonical path and how many of those we hold, cf. acquire_in_order_until()
+    std::vector<fs::path> ordered_lockfiles_;
+    size_t next_ordered_lock_ = 0;
+
+    //!\brief when we first asked for the locks (ms since epoch), cf. goldilock_spot::has_older_multi_lock_ahead()
+    size_t request_timestamp_ = 0;
+
+    //!\brief how often we look at the lines when waiting, cf. wait_in_line()
+    static constexpr std::chrono::milliseconds min_poll_interval = 100ms;
+    static constexpr std::chrono::milliseconds max_poll_interval = 2s;
+    static constexpr size_t near_head_turns = 2;
+
+    //!\brief where we were in line when we last looked and how long we meant to wait then, cf. get_poll_interval()
+    std::optional<size_t> turns_ahead_;
+
+    //!\brief how many spots were ahead of us in each of our current lines when we counted them, when that was and
+    //! how many spots left the queues since, cf. estimate_turns_ahead()
+    std::map<fs::path, size_t> spots_ahead_counted_;
+    std::chrono::steady_clock::time_point counted_at_;
+    size_t departed_since_count_ = 0;
+    std::chrono::milliseconds poll_interval_ = min_poll_interval;
+
+    //!\brief when to look at the lines again when far back in line at the latest, and how many of those ahead
+    //! of us have to leave for us to look sooner, cf. wait_for_next_look()
+    std::optional<std::chrono::steady_clock::time_point> next_look_;
+    size_t departures_to_near_head_ = 0;
+    size_t departures_ = 0;
+
+    mutable boost::mutex spots_mut_;
+    std::map<fs::path, goldilock_spot> spots_;
+    std::map<fs::path, lockfile_semaphore> file_locks_;
+    queue_watcher watcher_;
+
+    size_t failed_all_locks_acquire_ = 0;
+    size_t failed_all_locks_acquire_limit_ = random::random_in_range(5, 20); // stay in a kind-of similar range for this so that the re-enqueuing has a larger effect
+  };
+
+}
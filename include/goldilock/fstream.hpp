@@ -20,10 +20,13 @@ namespace tipi::goldilock::exclusive_fstream
     void operator()(std::FILE *fp) const { std::fclose(fp); }
   };
 
+  //!\brief create and open filename, failing (with errno == EEXIST) if it exists already
   inline std::fstream open(const char *filename, const std::string mode = "w")
   {
-    bool excl = [filename, mode] {
-      std::unique_ptr<std::FILE, FILE_closer> fp(std::fopen(filename, mode.data()));      
+    // "x" maps to O_CREAT|O_EXCL, the creation either wins atomically or fails
+    const std::string exclusive_mode = mode + "x";
+    bool excl = [filename, &exclusive_mode] {
+      std::unique_ptr<std::FILE, FILE_closer> fp(std::fopen(filename, exclusive_mode.data()));      
       return !!fp;
     }();
     auto saveerr = errno;
@@ -31,8 +34,9 @@ namespace tipi::goldilock::exclusive_fstream
     std::fstream stream;
 
     if (excl) {
-      fs::permissions(filename, fs::add_perms|fs::owner_write|fs::group_write|fs::others_write);
-      stream.open(filename);
+      boost::system::error_code ec;
+      fs::permissions(filename, fs::add_perms|fs::owner_write|fs::group_write|fs::others_write, ec);
+      stream.open(filename, std::ios::in | std::ios::out | std::ios::binary);
     }
     else {
       stream.setstate(std::ios::failbit);
@@ -2,16 +2,22 @@
 // SPDX-License-Identifier: GPL-2.0-only OR Proprietary
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
-#include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/interprocess/sync/file_lock.hpp>
 #include <boost/predef.h>
@@ -23,9 +29,17 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/string_generator.hpp>
+
+#if !BOOST_OS_WINDOWS
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <goldilock/file.hpp>
 #include <goldilock/fstream.hpp>
+#include <goldilock/spot_record.hpp>
 #include <goldilock/string.hpp>
 
 namespace tipi::goldilock {
@@ -40,7 +54,15 @@ namespace tipi::goldilock {
     return boost::lexical_cast<std::string>(uuid_gen());
   }
 
-  //!\brief get the numerial index suffixed to a lockfile from its filename
+  //!\brief what goldilock appends to the names of its spot files, after the index
+  //!
+  //! Goldilocks predating the binary spot records named their spots <lockfile>.<index> and delete
+  //! any such file they can't parse. They don't even look at <lockfile>.<index>.spot, so that
+  //! old and new goldilocks can share the lockfiles while hosts get upgraded one by one.
+  inline const std::string spot_file_suffix = ".spot"s;
+
+  //!\brief get the numerial index suffixed to a lockfile from its filename, either of the
+  //! binary spots (<lockfile>.<index>.spot) or of the legacy ones (<lockfile>.<index>)
   inline std::optional<size_t> extract_lockfile_spot_index(const fs::path& lockfile, const fs::path& p) {
     static std::map<fs::path, boost::regex> rx_cache;
 
@@ -50,7 +72,7 @@ namespace tipi::goldilock {
 
       std::string lockfile_name = lockfile.filename().generic_string();
       std::string lockfile_name_rx_str = regex_replace(lockfile_name, esc, rep, boost::match_default | boost::format_sed);
-      lockfile_name_rx_str += + "\\.(?<ix>[[:digit:]]+)$";
+      lockfile_name_rx_str += + "\\.(?<ix>[[:digit:]]+)(\\.spot)?$";
       rx_cache[lockfile] = boost::regex(lockfile_name_rx_str);
     }
 
@@ -65,17 +87,93 @@ namespace tipi::goldilock {
     return result;
   }
 
+  //!\brief whether a spot file was written by a goldilock predating the binary spot records
+  inline bool is_legacy_spot_path(const fs::path& p) {
+    return p.extension().generic_string() != spot_file_suffix;
+  }
+
+  //!\brief the path of the spot at index in the queue of lockfile kept in directory
+  inline fs::path get_lockfile_spot_path(const fs::path& directory, const fs::path& lockfile, size_t index) {
+    return directory / (lockfile.filename().generic_string() + "."s + std::to_string(index) + spot_file_suffix);
+  }
+
+  //!\brief the optional per-lockfile queue directory, cf. get_lockfile_queue_directory()
+  inline fs::path get_lockfile_dedicated_queue_directory(const fs::path& lockfile) {
+    return lockfile.parent_path() / (lockfile.filename().generic_string() + ".q"s);
+  }
+
+  //!\brief directory in which the spots waiting in line for lockfile live
+  //!
+  //! By default that's the lockfile's own directory, but as soon as a <lockfile>.q/ directory
+  //! exists (cf. goldilock --queue-dir) the spots move there so that scanning the queue doesn't
+  //! mean going through every unrelated file next to the lockfile
+  inline fs::path get_lockfile_queue_directory(const fs::path& lockfile) {
+    auto dedicated_directory = get_lockfile_dedicated_queue_directory(lockfile);
+    boost::system::error_code ec;
+    return fs::is_directory(dedicated_directory, ec) ? dedicated_directory : lockfile.parent_path();
+  }
+
   // forward decl
   struct goldilock_spot;  
   std::map<fs::path, goldilock_spot> list_lockfile_spots(const fs::path& lockfile_path);
+  std::map<fs::path, goldilock_spot> list_lockfile_spots_in(const fs::path& directory, const fs::path& lockfile);
+
+  //!\brief milliseconds since epoch, the unit of all spot timestamps
+  inline size_t to_unix_ms(std::chrono::system_clock::time_point time) {
+    return static_cast<size_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+  }
 
   struct goldilock_spot {     
 
+    //!\brief how long a spot stays valid after its last heartbeat unless its owner says otherwise
+    static constexpr std::chrono::milliseconds default_lease = 60s;
+
+    //!\brief how much waiting in line one level of priority is worth unless the owner says otherwise
+    static constexpr std::chrono::milliseconds default_priority_aging = 60s;
+
+    //!\brief how far ahead a deadline can move a spot in line at most, cf. is_ahead_of()
+    static constexpr std::chrono::milliseconds deadline_horizon = 1h;
+
+    //!\brief how far apart in line the spots of a tenant taking part in the fair share are (divided
+    //! by their weight), cf. get_in_line()
+    static constexpr std::chrono::milliseconds fair_share_quantum = 60s;
+
+    //!\brief what the owner of a spot file wrote in its record that never changes
+    struct owner_terms {
+      size_t lease_ms = static_cast<size_t>(default_lease.count());
+      size_t tokens = 1;
+      bool shared = false;
+      bool multi_lock = false;
+      size_t request_timestamp = 0;
+      int priority = 0;
+      size_t priority_aging_ms = static_cast<size_t>(default_priority_aging.count());
+      size_t deadline = 0;
+      uint64_t tenant = 0;
+      size_t fair_share_weight = 0;
+      int64_t fair_share_start = 0;
+      int64_t rank = 0;
+    };
+
     goldilock_spot(const fs::path& lockfile_path)
+      : goldilock_spot(lockfile_path, owner_terms{})
+    {
+    }
+
+    goldilock_spot(const fs::path& lockfile_path, const owner_terms& terms)
       : lockfile_{lockfile_path}
       , owned_{true}      
       , guid_{get_random_uuid()}
       , spot_index_{0}
+      , lease_ms_{terms.lease_ms}
+      , tokens_{std::max<size_t>(terms.tokens, 1)}
+      , shared_{terms.shared}
+      , multi_lock_{terms.multi_lock}
+      , request_timestamp_{terms.request_timestamp}
+      , priority_{terms.priority}
+      , priority_aging_ms_{terms.priority_aging_ms}
+      , deadline_{terms.deadline}
+      , tenant_{terms.tenant}
+      , fair_share_weight_{terms.fair_share_weight}
     {
       get_in_line();      
     }
@@ -91,47 +189,122 @@ namespace tipi::goldilock {
         current_spot_file_.reset();
       }
 
-      bool got_spot = false;
-      while(!got_spot) {
+      #if !BOOST_OS_WINDOWS
+      liveness_lock_.reset();
+      #endif
+
+      blockers_.clear();
+      older_multi_lock_ahead_.reset();
+      sibling_layout_spots_.clear();
+
+      queue_directory_ = get_lockfile_queue_directory(lockfile_);
+
+      // while migrating to a dedicated queue directory, goldilocks that were already waiting
+      // next to the lockfile keep their place ahead of us (checked only once, here)
+      if(queue_directory_ != lockfile_.parent_path()) {
+        for(const auto& [path, spot] : list_lockfile_spots_in(lockfile_.parent_path(), lockfile_)) {
+          sibling_layout_spots_.push_back(path);
+        }
+      }
+
+      // start right behind the current end of the queue...
+      auto spots = list_lockfile_spots_in(queue_directory_, lockfile_);
+
+      auto max_spot_it = std::max_element(
+        spots.begin(),
+        spots.end(),
+        [](const auto& a, const auto& b) { 
+          return a.second.get_spot_index() < b.second.get_spot_index(); 
+        }
+      );
+
+      spot_index_ = (max_spot_it != spots.end()) ? max_spot_it->second.spot_index_ + 1 : 0;
+
+      timestamp_ = to_unix_ms(std::chrono::system_clock::now());
 
-        // try to get to own the spot
-        auto spots = list_lockfile_spots(lockfile_);
+      // a multi-lock request getting back in line keeps its age
+      int64_t waiting_since = static_cast<int64_t>((multi_lock_ && request_timestamp_ != 0) ? request_timestamp_ : timestamp_);
 
-        auto max_spot_it = std::max_element(
-          spots.begin(),
-          spots.end(),
-          [](const auto& a, const auto& b) { 
-            return a.second.get_spot_index() < b.second.get_spot_index(); 
+      // taking part in the fair share we start a quantum (the shorter the higher our weight) after the
+      // last spot of our tenant in line, so that tenants take turns instead of whoever came first with
+      // the most goldilocks holding up everyone else
+      fair_share_start_ = 0;
+      if(fair_share_weight_ > 0) {
+        int64_t step = std::max<int64_t>(static_cast<int64_t>(fair_share_quantum.count()) / static_cast<int64_t>(fair_share_weight_), 1);
+        fair_share_start_ = waiting_since;
+
+        for(const auto& [path, spot] : spots) {
+          if(spot.tenant_ == tenant_ && spot.fair_share_start_ != 0) {
+            fair_share_start_ = std::max(fair_share_start_, spot.fair_share_start_ + step);
           }
-        );
+        }
+      }
 
-        if(max_spot_it != spots.end()) {
-          spot_index_ = max_spot_it->second.spot_index_ + 1;
+      rank_ = ((fair_share_start_ != 0) ? fair_share_start_ : waiting_since) - static_cast<int64_t>(priority_) * static_cast<int64_t>(priority_aging_ms_);
+
+      // the less time left until our deadline the further ahead, up to deadline_horizon
+      if(deadline_ != 0) {
+        int64_t horizon = static_cast<int64_t>(deadline_horizon.count());
+        int64_t slack = static_cast<int64_t>(deadline_) - static_cast<int64_t>(waiting_since);
+        rank_ -= horizon - std::clamp<int64_t>(slack, 0, horizon);
+      }
+
+      // ...and claim the first free index from there. The spot is written to a private staging
+      // file first and then published with a hard link, which atomically fails if someone else
+      // got that index already. Nobody ever gets to see a half written spot that way.
+      // The staging file is flock()-ed before being published, so that the spot is never
+      // seen without the lock proving we're alive (cf. reclaim_if_abandoned())
+      fs::path staging_path = queue_directory_ / (lockfile_.filename().generic_string() + "."s + guid_ + ".tmp"s);
+      bool use_hard_links = false;
+      {
+        auto staging_stream = exclusive_fstream::open(staging_path, "w");
+        if(staging_stream.is_open()) {
+          take_liveness_lock(staging_path);
+          write_to(staging_stream);
+          staging_stream.close();
+          use_hard_links = true;
         }
+      }
 
-        auto now = std::chrono::system_clock::now();
-        timestamp_ = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+      BOOST_SCOPE_EXIT(&staging_path) {
+        boost::system::error_code fsec;
+        fs::remove(staging_path, fsec); // doesn't throw / fail silently
+      } BOOST_SCOPE_EXIT_END
 
+      while(true) {
         fs::path spot_path = get_spot_path();
 
-        {
-          auto lockfile_stream = exclusive_fstream::open(spot_path, "w");
-          if(lockfile_stream.is_open()) {
-            boost::archive::text_oarchive oa(lockfile_stream);
-            oa << *this;
+        if(use_hard_links) {
+          boost::system::error_code ec;
+          fs::create_hard_link(staging_path, spot_path, ec);
 
-            lockfile_stream.close();
+          if(!ec) {
+            current_spot_file_ = spot_path;
+            break;
+          }
+          else if(ec == boost::system::errc::file_exists) {
+            spot_index_++;
+            continue;
           }
-        }
 
-        // now read and see if the contents are as expected
-        {
-          auto read_back = goldilock_spot::try_read_from(spot_path, lockfile_);
-          got_spot = (read_back.has_value() && read_back->get_guid() == get_guid() && read_back->get_timestamp() ==  get_timestamp());
+          // no hard links on this filesystem - claim the index with an exclusive create instead
+          use_hard_links = false;
         }
 
-        if(got_spot) {
+        auto spot_stream = exclusive_fstream::open(spot_path, "w");
+        if(spot_stream.is_open()) {
+          take_liveness_lock(spot_path);  // still empty at this point, so nobody mistakes it for abandoned
+          write_to(spot_stream);
+          spot_stream.close();
+
           current_spot_file_ = spot_path;
+          break;
+        }
+        else if(errno == EEXIST) {
+          spot_index_++;
+        }
+        else {
+          throw std::runtime_error("Could not create spot in line for lockfile "s + lockfile_.generic_string() + ": "s + std::strerror(errno));
         }
       }
 
@@ -146,32 +319,231 @@ namespace tipi::goldilock {
       }
     }
 
+    //!\brief heartbeat - the modification time of the spot file is what tells the others we're alive,
+    //! the record itself is written once when getting in line and never rewritten
     void update_spot() {
       if(!owned_) {
         throw std::runtime_error("Cannot update someone else's lockfile: "s + lockfile_.generic_string());
       }
 
       auto now = std::chrono::system_clock::now();
-      timestamp_ = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-      std::ofstream ofs(get_spot_path().generic_string());
-      boost::archive::text_oarchive oa(ofs);
-      oa << *this;
+      timestamp_ = to_unix_ms(now);
+
+      #if !BOOST_OS_WINDOWS
+      if(liveness_lock_) {
+        if(file::set_last_write_time(liveness_lock_->native_handle(), now)) {
+          return;
+        }
+
+        // someone removed our spot in the meantime (considered it expired), and the name might
+        // belong to a newcomer already: get back in line instead of touching what isn't ours
+        current_spot_file_.reset();
+        get_in_line();
+        return;
+      }
+      #endif
+
+      if(!file::set_last_write_time(get_spot_path(), now)) {
+        // someone removed our spot in the meantime (e.g. considered it expired), put it back in place
+        spot_record::overwrite(get_spot_path(), to_record().encode());
+      }
     }
 
     static goldilock_spot read_from(const fs::path& spot_on_disk, const fs::path& lockfile_path) {
       goldilock_spot result;
 
-      // boost::serialization
-      std::ifstream ifs(spot_on_disk.generic_string());
-      boost::archive::text_iarchive ia(ifs);
-      ia >> result;
+      auto raw = spot_record::read_raw(spot_on_disk);
+      auto data = reinterpret_cast<const unsigned char *>(raw.data());
+
+      if(spot_record::has_magic(data, raw.size())) {
+        auto record = spot_record::decode(data, raw.size());
+        if(!record) {
+          throw std::runtime_error("Invalid or incomplete spot record: "s + spot_on_disk.generic_string());
+        }
+
+        result.timestamp_ = record->timestamp;
+        result.guid_ = boost::uuids::to_string(record->guid);
+        result.lease_ms_ = (record->lease_ms > 0) ? record->lease_ms : static_cast<size_t>(default_lease.count());
+        result.tokens_ = record->tokens;
+        result.shared_ = (record->flags & spot_record::flag_shared) != 0;
+        result.multi_lock_ = (record->flags & spot_record::flag_multi_lock) != 0;
+        result.request_timestamp_ = record->request_timestamp;
+        result.priority_ = record->priority;
+        result.rank_ = record->rank;
+        result.deadline_ = record->deadline;
+        result.tenant_ = record->tenant;
+        result.fair_share_start_ = record->fair_share_start;
+      }
+      else {
+        // spots written by goldilock versions before the binary format (boost::serialization)
+        std::istringstream iss(raw);
+        boost::archive::text_iarchive ia(iss);
+        ia >> result;
+        result.lease_ms_ = static_cast<size_t>(default_lease.count());
+        result.rank_ = static_cast<int64_t>(result.timestamp_);
+      }
 
       result.lockfile_ = fs::weakly_canonical(lockfile_path);
+      result.queue_directory_ = spot_on_disk.parent_path();
       result.owned_ = false;
       result.spot_index_ = extract_lockfile_spot_index(result.lockfile_, spot_on_disk).value();      
+      result.legacy_ = is_legacy_spot_path(spot_on_disk);
+      return result;
+    }
+
+    //!\brief what the directory entry tells about a spot: the index from its filename and the last
+    //! heartbeat from its modification time. The contents are only read the first time a spot file
+    //! is seen to learn the lease and tokens of its owner, cf. get_owner_terms()
+    static std::optional<goldilock_spot> try_stat_from(const fs::path& spot_on_disk, const fs::path& lockfile_path) {
+      auto spot_index = extract_lockfile_spot_index(lockfile_path, spot_on_disk);
+      if(!spot_index) {
+        return std::nullopt;
+      }
+
+      auto status = file::get_file_status(spot_on_disk);
+      if(!status) {
+        return std::nullopt;
+      }
+
+      goldilock_spot result;
+      result.lockfile_ = lockfile_path;
+      result.queue_directory_ = spot_on_disk.parent_path();
+      result.owned_ = false;
+      result.spot_index_ = spot_index.value();
+      result.legacy_ = is_legacy_spot_path(spot_on_disk);
+      result.timestamp_ = to_unix_ms(status->last_write_time);
+      auto terms = get_owner_terms(spot_on_disk, status.value());
+      result.lease_ms_ = terms.lease_ms;
+      result.tokens_ = terms.tokens;
+      result.shared_ = terms.shared;
+      result.multi_lock_ = terms.multi_lock;
+      result.request_timestamp_ = terms.request_timestamp;
+      result.priority_ = terms.priority;
+      result.deadline_ = terms.deadline;
+      result.tenant_ = terms.tenant;
+      result.fair_share_start_ = terms.fair_share_start;
+      // unknown while the record isn't written yet (only without hard links, cf. get_in_line()): just got in line
+      result.rank_ = (terms.rank != 0) ? terms.rank : static_cast<int64_t>(result.timestamp_);
       return result;
     }
 
+    //!\brief the lease, tokens, lock mode and request of the owner of a spot file, read once per spot file
+    //!
+    //! Spot records are never rewritten, so what we read stays true as long as the same file (device
+    //! and inode) is around under that name. Spots of goldilocks predating the binary records, and
+    //! those we can't read yet (still being written), get the defaults.
+    static owner_terms get_owner_terms(const fs::path& spot_on_disk, const file::file_status& status) {
+      struct known_terms {
+        uint64_t device;
+        uint64_t inode;
+        owner_terms terms;
+      };
+
+      static std::map<fs::path, known_terms> terms_cache;
+
+      auto it = terms_cache.find(spot_on_disk);
+      if(it != terms_cache.end() && it->second.device == status.device && it->second.inode == status.inode && status.inode != 0) {
+        return it->second.terms;
+      }
+
+      std::optional<owner_terms> terms;
+      try {
+        auto raw = spot_record::read_raw(spot_on_disk);
+        auto data = reinterpret_cast<const unsigned char *>(raw.data());
+
+        if(spot_record::has_magic(data, raw.size())) {
+          if(auto record = spot_record::decode(data, raw.size()); record.has_value()) {
+            terms = owner_terms{};
+            terms->lease_ms = (record->lease_ms > 0) ? record->lease_ms : static_cast<size_t>(default_lease.count());
+            terms->tokens = record->tokens;
+            terms->shared = (record->flags & spot_record::flag_shared) != 0;
+            terms->multi_lock = (record->flags & spot_record::flag_multi_lock) != 0;
+            terms->request_timestamp = record->request_timestamp;
+            terms->priority = record->priority;
+            terms->rank = record->rank;
+            terms->deadline = record->deadline;
+            terms->tenant = record->tenant;
+            terms->fair_share_start = record->fair_share_start;
+          }
+        }
+        else if(!raw.empty()) {
+          // legacy text archive, its owner rewrites it with every heartbeat: ranked by the timestamp
+          // it had when we first read it, so that it doesn't fall behind newcomers with every heartbeat
+          goldilock_spot legacy;
+          std::istringstream iss(raw);
+          boost::archive::text_iarchive ia(iss);
+          ia >> legacy;
+
+          terms = owner_terms{};
+          terms->rank = static_cast<int64_t>(legacy.timestamp_);
+        }
+      }
+      catch(...) {
+        //
+      }
+
+      // gone, empty or torn - we'll know better next time
+      if(!terms) {
+        return owner_terms{};
+      }
+
+      // spots come and go, don't let the cache grow for ever in long waits on busy queues
+      if(terms_cache.size() > 4096) {
+        terms_cache.clear();
+      }
+
+      terms_cache[spot_on_disk] = known_terms{ status.device, status.inode, terms.value() };
+      return terms.value();
+    }
+
+    //!\brief remove the spot at spot_on_disk if its owner is known to be dead
+    //!
+    //! Owners hold an exclusive flock() on their spot file as long as they live and the kernel drops it
+    //! the moment they die, whatever the cause (SIGKILL, OOM killer...) and whichever pid namespace
+    //! they ran in. If we can get a shared lock on a spot that says its owner holds the flock() it is
+    //! abandoned and gets removed right away instead of blocking the queue until it expires.
+    //! Spots of goldilocks not holding that lock (legacy text spots, windows) are left alone.
+    //! Opening and locking a spot file costs much more than a stat(), so that's only done for the
+    //! spots we wait behind and, when scanning the queue, for the head of the line and those that
+    //! missed a heartbeat.
+    //!\return true if the spot was removed
+    static bool reclaim_if_abandoned(const fs::path& spot_on_disk) {
+      #if BOOST_OS_WINDOWS
+      return false;
+      #else
+      int fd = ::open(spot_on_disk.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd < 0) {
+        return false;
+      }
+
+      BOOST_SCOPE_EXIT(&fd) {
+        ::close(fd);
+      } BOOST_SCOPE_EXIT_END
+
+      if(::flock(fd, LOCK_SH | LOCK_NB) != 0) {
+        return false;  // alive (or we can't tell)
+      }
+
+      auto raw = spot_record::read_raw(fd);
+      if(!raw) {
+        return false;
+      }
+
+      auto record = spot_record::decode(reinterpret_cast<const unsigned char *>(raw->data()), raw->size());
+      if(!record || (record->flags & spot_record::flag_owner_holds_flock) == 0) {
+        return false;
+      }
+
+      // only remove what we probed - not a new spot that took the same name in the meantime
+      struct stat by_fd, by_path;
+      if(::fstat(fd, &by_fd) != 0 || ::stat(spot_on_disk.c_str(), &by_path) != 0 || by_fd.st_dev != by_path.st_dev || by_fd.st_ino != by_path.st_ino) {
+        return false;
+      }
+
+      return ::unlink(spot_on_disk.c_str()) == 0;
+      #endif
+    }
+
     static std::optional<goldilock_spot> try_read_from(const fs::path& spot_on_disk, const fs::path& lockfile_path) {
       try {
         return read_from(spot_on_disk, lockfile_path);
@@ -184,41 +556,213 @@ namespace tipi::goldilock {
     }
 
     bool is_first_in_line() const {
-      // try to get to own the spot
-      auto spots = list_lockfile_spots(lockfile_);
+      // goldilocks of the old layout ahead of us go first
+      if(count_sibling_layout_spots_ahead() > 0) {
+        return false;
+      }
 
-      auto min_spot_it = std::min_element(
-        spots.begin(),
-        spots.end(),
-        [](const auto& a, const auto& b) { 
-          return a.second.get_spot_index() < b.second.get_spot_index(); 
+      // as long as the spot right ahead of us is still alive we can't be first, and as new
+      // spots always get in line behind the highest index that's all we need to look at (a
+      // newcomer with a priority may pass us too, but that doesn't make us first either)
+      if(is_still_blocked()) {
+        return false;
+      }
+
+      // the predecessor is gone (or we don't know it yet), rescan the whole queue
+      auto spots = list_lockfile_spots_in(queue_directory_, lockfile_);
+      bool by_rank = uses_ranks(spots);
+
+      bool in_line = false;
+      const goldilock_spot *predecessor = nullptr;
+
+      for(const auto& [path, spot] : spots) {
+        if(spot.get_spot_index() == spot_index_) {
+          in_line = true;
         }
-      );
+        else if(spot.is_ahead_of(*this, by_rank) && (!predecessor || predecessor->is_ahead_of(spot, by_rank))) {
+          predecessor = &spot;
+          blockers_ = { path };  // remember who's right ahead of us for the next rounds
+        }
+      }
+
+      return in_line && !predecessor;
+    }
+
+    //!\brief whether the live spots ahead of us in line and ours need no more than capacity tokens
+    //! altogether (goldilock --slots / --tokens), which makes it strictly first come first served
+    bool is_within_capacity(size_t capacity) const {
+      if(capacity <= 1) {
+        return is_first_in_line();
+      }
+
+      // spots of the old layout need a single token each
+      size_t sibling_tokens = count_sibling_layout_spots_ahead();
+
+      // the closest spots ahead of us still need too many tokens, cf. is_first_in_line()
+      if(is_still_blocked()) {
+        return false;
+      }
+
+      auto spots = list_lockfile_spots_in(queue_directory_, lockfile_);
+      bool by_rank = uses_ranks(spots);
+
+      size_t needed = sibling_tokens + tokens_;
+      std::vector<std::pair<fs::path, const goldilock_spot *>> ahead;
+
+      for(const auto& [path, spot] : spots) {
+        if(spot.is_ahead_of(*this, by_rank)) {
+          needed += spot.get_tokens();
+          ahead.emplace_back(path, &spot);
+        }
+      }
+
+      if(needed <= capacity) {
+        return true;
+      }
+
+      // the closest ones ahead of us are the last to leave: remember those that are enough to keep us waiting
+      std::sort(ahead.begin(), ahead.end(), [by_rank](const auto& a, const auto& b) { return a.second->is_ahead_of(*b.second, by_rank); });
 
-      if(min_spot_it != spots.end()) {
-        return min_spot_it->second.guid_ == guid_;
+      size_t blocking_tokens = tokens_;
+      for(auto it = ahead.rbegin(); it != ahead.rend() && blocking_tokens <= capacity; ++it) {
+        blocking_tokens += it->second->get_tokens();
+        blockers_.push_back(it->first);
+      }
+
+      // only the spots of the old layout make the difference, those are checked anyway
+      if(blocking_tokens <= capacity) {
+        blockers_.clear();
       }
 
       return false;
     }
 
+    //!\brief whether only shared spots are ahead of us in line, i.e. we're one of the group of shared
+    //! owners at the head of the queue that hold the lock together (goldilock --shared)
+    bool is_among_shared_at_head() const {
+      // spots of the old layout are exclusive
+      if(count_sibling_layout_spots_ahead() > 0) {
+        return false;
+      }
+
+      // the closest exclusive spot ahead of us is still there, cf. is_first_in_line()
+      if(is_still_blocked()) {
+        return false;
+      }
+
+      auto spots = list_lockfile_spots_in(queue_directory_, lockfile_);
+      bool by_rank = uses_ranks(spots);
+
+      const goldilock_spot *closest_exclusive = nullptr;
+
+      for(const auto& [path, spot] : spots) {
+        if(spot.is_ahead_of(*this, by_rank) && !spot.is_shared() && (!closest_exclusive || closest_exclusive->is_ahead_of(spot, by_rank))) {
+          closest_exclusive = &spot;
+          blockers_ = { path };
+        }
+      }
+
+      return !closest_exclusive;
+    }
+
+    //!\brief how many live spots are ahead of us in line, cf. file_lock_backend::estimate_turns_ahead()
+    size_t count_spots_ahead() const {
+      size_t count = count_sibling_layout_spots_ahead();
+
+      auto spots = list_lockfile_spots_in(queue_directory_, lockfile_);
+      bool by_rank = uses_ranks(spots);
+
+      for(const auto& [path, spot] : spots) {
+        if(spot.is_ahead_of(*this, by_rank)) {
+          count++;
+        }
+      }
+
+      return count;
+    }
+
+    //!\brief whether a multi-lock owner that asked for its locks no later than ours waits ahead of us
+    //!
+    //! Multi-lock owners keep their place in line while waiting for their other locks, except for
+    //! those having to give way to such an owner: that breaks any circle of owners waiting for each
+    //! other and the oldest request is never sent back to the end of the lines.
+    bool has_older_multi_lock_ahead() const {
+      // the one we found last time is still there
+      if(older_multi_lock_ahead_ && is_still_waiting(older_multi_lock_ahead_.value())) {
+        return true;
+      }
+
+      older_multi_lock_ahead_.reset();
+
+      auto spots = list_lockfile_spots_in(queue_directory_, lockfile_);
+      bool by_rank = uses_ranks(spots);
+
+      for(const auto& [path, spot] : spots) {
+        if(spot.is_ahead_of(*this, by_rank) && spot.is_multi_lock() && spot.get_request_timestamp() <= request_timestamp_) {
+          older_multi_lock_ahead_ = path;
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    spot_record to_record() const {
+      spot_record record;
+      record.timestamp = timestamp_;
+      record.guid = boost::uuids::string_generator()(guid_);
+      record.lease_ms = static_cast<uint32_t>(lease_ms_);
+      record.tokens = static_cast<uint32_t>(tokens_);
+
+      if(shared_) {
+        record.flags |= spot_record::flag_shared;
+      }
+
+      if(multi_lock_) {
+        record.flags |= spot_record::flag_multi_lock;
+        record.request_timestamp = request_timestamp_;
+      }
+
+      record.priority = static_cast<int32_t>(priority_);
+      record.rank = rank_;
+      record.deadline = deadline_;
+      record.tenant = tenant_;
+      record.fair_share_start = fair_share_start_;
+
+      #if !BOOST_OS_WINDOWS
+      if(liveness_lock_) {
+        record.flags |= spot_record::flag_owner_holds_flock;
+      }
+      #endif
+
+      return record;
+    }
+
+    template<class Stream>
+    void write_to(Stream& stream) const {
+      auto buffer = to_record().encode();
+      stream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    }
+
+    // legacy text format, only ever read from the spots of older goldilocks
     friend class boost::serialization::access;
     template<class Archive>
-    void serialize(Archive & ar, const unsigned int version)
+    void load(Archive & ar, const unsigned int version)
     {
-      ar &timestamp_;
-      ar &guid_;
+      size_t timestamp_seconds = 0;  // whole seconds in that format
+      ar >> timestamp_seconds;
+      ar >> guid_;
+      timestamp_ = timestamp_seconds * 1000;
     }
 
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+
     fs::path get_spot_path() const {
       if(current_spot_file_) {
         return current_spot_file_.value();
       }
 
-      auto parent_folder = lockfile_.parent_path();
-      auto filename = lockfile_.filename().generic_string();
-      
-      return parent_folder / (filename + "."s + std::to_string(spot_index_));
+      return get_lockfile_spot_path(queue_directory_, lockfile_, spot_index_);
     }
 
     fs::path get_lockfile_path() const {
@@ -238,29 +782,172 @@ namespace tipi::goldilock {
       return owned_;
     }
 
-    //!\brief is the spot expired
+    //!\brief last heartbeat, in milliseconds since epoch
     size_t get_timestamp() const {
       return timestamp_;
     }
 
-    bool is_valid(uint16_t lifetime_seconds = 60) const {
-      auto end_of_validity = timestamp_ + lifetime_seconds; // expires after 60s
-      auto now = std::chrono::system_clock::now();
-      auto unix_ts_now = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-      return end_of_validity >= unix_ts_now;
+    //!\brief how long the spot stays valid after a heartbeat, as decided by its owner
+    std::chrono::milliseconds get_lease() const {
+      return std::chrono::milliseconds(lease_ms_);
+    }
+
+    size_t get_tokens() const {
+      return tokens_;
+    }
+
+    bool is_shared() const {
+      return shared_;
+    }
+
+    bool is_multi_lock() const {
+      return multi_lock_;
+    }
+
+    //!\brief when a multi-lock owner first asked for its locks, in milliseconds since epoch
+    size_t get_request_timestamp() const {
+      return request_timestamp_;
+    }
+
+    int get_priority() const {
+      return priority_;
+    }
+
+    //!\brief goldilock --deadline of the owner in milliseconds since epoch, 0 if it has none
+    size_t get_deadline() const {
+      return deadline_;
+    }
+
+    //!\brief whether the owner takes part in the fair share between tenants (goldilock --fair-share)
+    bool is_fair_shared() const {
+      return fair_share_start_ != 0;
+    }
+
+    //!\brief whether this spot comes before other in line: by spot index, unless priorities or
+    //! deadlines are involved (by_rank, cf. uses_ranks()) in which case the rank goes first
+    //!
+    //! The rank is when the owner got in line minus its priority times its priority aging, so a
+    //! higher priority passes those that got in line less than that long before, but nobody is
+    //! passed for ever by later arrivals (goldilock --priority / --priority-aging).
+    //! A deadline closer than deadline_horizon moves the rank ahead by what it lacks to the horizon:
+    //! spots with deadlines take turns earliest deadline first and pass those without that got in
+    //! line less than that long before. Declaring a deadline that's past already passes nobody that
+    //! waited for longer than deadline_horizon (goldilock --deadline).
+    //! Spots taking part in the fair share between tenants start from their fair share start instead
+    //! of when they got in line, cf. get_in_line() (goldilock --tenant / --fair-share).
+    bool is_ahead_of(const goldilock_spot& other, bool by_rank) const {
+      if(by_rank && rank_ != other.rank_) {
+        return rank_ < other.rank_;
+      }
+
+      if(spot_index_ != other.spot_index_) {
+        return spot_index_ < other.spot_index_;
+      }
+
+      // an older goldilock got the same index without seeing our spot: it goes first, as it can't know about us
+      return legacy_ && !other.legacy_;
+    }
+
+    bool is_valid() const {
+      auto end_of_validity = timestamp_ + lease_ms_;
+      return end_of_validity >= to_unix_ms(std::chrono::system_clock::now());
+    }
+
+    bool is_expired() const {
+      return !is_valid();
+    }
+
+    //!\brief whether the owner didn't refresh the spot for longer than its heartbeat interval would be by
+    //! default (a quarter of the lease), which is when scans probe it for abandonment, cf. reclaim_if_abandoned()
+    bool missed_heartbeat() const {
+      auto heartbeat_due = timestamp_ + lease_ms_ / 4;
+      return heartbeat_due < to_unix_ms(std::chrono::system_clock::now());
     }
 
-    bool is_expired(uint16_t lifetime_seconds = 60) const {
-      return !is_valid(lifetime_seconds);
+    //!\brief whether the owner has a priority, a deadline or takes part in the fair share, which orders
+    //! the whole line by rank, cf. is_ahead_of()
+    bool is_ranked() const {
+      return priority_ != 0 || deadline_ != 0 || is_fair_shared();
     }
 
   private:
+    //!\brief whether the line is ordered by rank, i.e. anyone in it is ranked, cf. is_ahead_of()
+    bool uses_ranks(const std::map<fs::path, goldilock_spot>& spots) const {
+      return is_ranked() || std::any_of(spots.begin(), spots.end(), [](const auto& pair) { return pair.second.is_ranked(); });
+    }
+
+    //!\brief goldilocks of the old layout still waiting ahead of us (forgetting about those that left)
+    size_t count_sibling_layout_spots_ahead() const {
+      if(!sibling_layout_spots_.empty()) {
+        sibling_layout_spots_.erase(
+          std::remove_if(
+            sibling_layout_spots_.begin(), 
+            sibling_layout_spots_.end(), 
+            [this](const fs::path& sibling_spot) {
+              auto spot = goldilock_spot::try_stat_from(sibling_spot, lockfile_);
+              return !spot.has_value() || spot->is_expired() || (spot->missed_heartbeat() && goldilock_spot::reclaim_if_abandoned(sibling_spot));
+            }
+          ),
+          sibling_layout_spots_.end()
+        );
+      }
+
+      return sibling_layout_spots_.size();
+    }
+
+    //!\brief whether the spot at spot_on_disk still waits in line: there, within its lease and not abandoned
+    bool is_still_waiting(const fs::path& spot_on_disk) const {
+      auto spot = goldilock_spot::try_stat_from(spot_on_disk, lockfile_);
+      return spot.has_value() && spot->is_valid() && !goldilock_spot::reclaim_if_abandoned(spot_on_disk);
+    }
+
+    //!\brief whether the spots that kept us waiting at the last scan of the queue still do (forgetting them otherwise)
+    //!
+    //! Those are the closest spots ahead of us that are enough to keep us waiting, i.e. the last of them to
+    //! leave: as long as they're alive there's no need to scan the whole queue. They are probed for abandonment
+    //! on every check, scans only probe the head of the line and the spots that missed a heartbeat.
+    bool is_still_blocked() const {
+      if(blockers_.empty()) {
+        return false;
+      }
+
+      if(!std::all_of(blockers_.begin(), blockers_.end(), [this](const fs::path& blocker) { return is_still_waiting(blocker); })) {
+        blockers_.clear();
+        return false;
+      }
+
+      return true;
+    }
+
     goldilock_spot() { /* for deserialization */ }
+
+    //!\brief hold an exclusive flock() on path for as long as our spot lives, cf. reclaim_if_abandoned()
+    void take_liveness_lock(const fs::path& path) {
+      #if !BOOST_OS_WINDOWS
+      liveness_lock_ = file::lock_file_exclusively(path);
+      #endif
+    }
+
     //!\brief absolute path as resolved
     fs::path lockfile_;
 
     std::optional<fs::path> current_spot_file_;
 
+    //!\brief written by a goldilock predating the binary spot records, cf. spot_file_suffix
+    bool legacy_ = false;
+
+    //!\brief where our spot lives, cf. get_lockfile_queue_directory()
+    fs::path queue_directory_;
+
+    //!\brief the spots ahead of ours that kept us waiting at the last full scan of the queue, cf. is_still_blocked()
+    mutable std::vector<fs::path> blockers_;
+
+    //!\brief the multi-lock spot ahead of ours we have to give way to, cf. has_older_multi_lock_ahead()
+    mutable std::optional<fs::path> older_multi_lock_ahead_;
+
+    //!\brief spots of the old layout (next to the lockfile) that were there before we got in line
+    mutable std::vector<fs::path> sibling_layout_spots_;
+
     //!\brief our spot in line
     size_t spot_index_ = 0;
 
@@ -270,60 +957,105 @@ namespace tipi::goldilock {
     //!\brief our own or someone else's?
     bool owned_ = false;
 
-    //!\brief is the spot expired
+    //!\brief last heartbeat (ms since epoch)
     size_t timestamp_ = 0;
+
+    //!\brief validity of the spot after a heartbeat (ms)
+    size_t lease_ms_ = static_cast<size_t>(default_lease.count());
+
+    //!\brief units of the lock's capacity our owner holds once it gets the lock
+    size_t tokens_ = 1;
+
+    //!\brief our owner holds the lock shared with other shared owners
+    bool shared_ = false;
+
+    //!\brief our owner waits in other lines too and keeps its place in them, cf. has_older_multi_lock_ahead()
+    bool multi_lock_ = false;
+
+    //!\brief when our multi-lock owner first asked for its locks (ms since epoch)
+    size_t request_timestamp_ = 0;
+
+    //!\brief goldilock --priority of our owner
+    int priority_ = 0;
+
+    //!\brief how much waiting in line one level of priority is worth (ms)
+    size_t priority_aging_ms_ = static_cast<size_t>(default_priority_aging.count());
+
+    //!\brief goldilock --deadline of our owner (ms since epoch, 0 if none)
+    size_t deadline_ = 0;
+
+    //!\brief goldilock --tenant of our owner, cf. spot_record::get_tenant_key()
+    uint64_t tenant_ = 0;
+
+    //!\brief goldilock --fair-share weight of our owner, 0 if it doesn't take part
+    size_t fair_share_weight_ = 0;
+
+    //!\brief where we start in line among the spots of our tenant taking part in the fair share, cf. get_in_line()
+    int64_t fair_share_start_ = 0;
+
+    //!\brief our place in line once priorities or deadlines are involved, cf. is_ahead_of()
+    int64_t rank_ = 0;
+
+    #if !BOOST_OS_WINDOWS
+    //!\brief the flock() on our spot file telling the others we're alive
+    std::shared_ptr<file::flock_guard> liveness_lock_;
+    #endif
   };
 
   //!\brief list all lockfiles given a lockfile path "waiting in line" and clear expired ones
   inline std::map<fs::path, goldilock_spot> list_lockfile_spots(const fs::path& lockfile_path) {
+    fs::path lockfile = fs::weakly_canonical(fs::path(lockfile_path));
+    return list_lockfile_spots_in(get_lockfile_queue_directory(lockfile), lockfile);
+  }
+
+  //!\brief list the spots of (canonical) lockfile in directory and clear expired ones
+  //!
+  //! Only the directory listing and the spot files' metadata are used, see goldilock_spot::try_stat_from(),
+  //! except for the spot at the head of the line and those that missed a heartbeat: those are probed for
+  //! abandonment (and removed if so). Whoever waits for the head learns that its owner died with the next
+  //! scan that way, the others don't hold anyone up before their turn comes.
+  inline std::map<fs::path, goldilock_spot> list_lockfile_spots_in(const fs::path& directory, const fs::path& lockfile) {
     std::map<fs::path, goldilock_spot> result;
-    fs::path parent_path = fs::weakly_canonical(fs::path(lockfile_path)).parent_path();     
 
-    for(auto & directory_entry : boost::filesystem::directory_iterator(parent_path)) {
+    for(auto & directory_entry : boost::filesystem::directory_iterator(directory)) {
 
       if(!directory_entry.is_regular_file()) {
         continue;
       }
 
-      auto locker_in_line = extract_lockfile_spot_index(lockfile_path, directory_entry.path());
+      auto spot = goldilock_spot::try_stat_from(directory_entry.path(), lockfile);
 
-      // this means it is a potentially valid lock file
-      if(locker_in_line.has_value()) {
-
-        bool delete_spot = false;
-        bool read_success = false;
+      // not a spot of this lockfile or already gone again
+      if(!spot.has_value()) {
+        continue;
+      }
 
-        size_t read_retries = 0;
-        const size_t max_read_retries = 50;
+      if(spot->is_expired()) {
+        boost::system::error_code fsec;
+        fs::remove(directory_entry.path(), fsec); // fail silently... 
+        continue;
+      }
 
-        while(!read_success && read_retries++ < max_read_retries) {
+      if(spot->missed_heartbeat() && goldilock_spot::reclaim_if_abandoned(directory_entry.path())) {
+        continue;
+      }
 
-          try {
-            auto spot = goldilock_spot::read_from(directory_entry.path(), lockfile_path);
-            read_success = true;
-            delete_spot = spot.is_expired();
+      result.insert({ directory_entry.path(), spot.value() });
+    }
 
-            if(!delete_spot) {
-              result.insert({ directory_entry.path(), spot });
-            }
-          }
-          catch(...) {
-            // this is not totally unexpected... we have a couple of retries to make sure we don't fail on transient states
-          }
-        }    
+    bool by_rank = std::any_of(result.begin(), result.end(), [](const auto& pair) { return pair.second.is_ranked(); });
 
-        if(!read_success && read_retries >= max_read_retries) {
-          delete_spot = true;
-          std::cerr << "Warning - deleting broken lock spot:" << directory_entry.path() << std::endl;
-        }
+    while(!result.empty()) {
+      auto head = std::min_element(result.begin(), result.end(), [by_rank](const auto& a, const auto& b) { return a.second.is_ahead_of(b.second, by_rank); });
 
-        if(delete_spot) {
-          boost::system::error_code fsec;
-          fs::remove(directory_entry.path(), fsec); // fail silently... 
-        }
+      // probed already otherwise
+      if(head->second.missed_heartbeat() || !goldilock_spot::reclaim_if_abandoned(head->first)) {
+        break;
       }
+
+      result.erase(head);
     }
 
     return result;
   }
-}
\ No newline at end of file
+}
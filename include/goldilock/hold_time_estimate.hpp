@@ -0,0 +1,60 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include <goldilock/file.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::string_literals;
+
+  //!\brief how long the lock on a lockfile is usually held, as told by its holders in <lockfile>.hold-time
+  //!
+  //! That's an exponentially weighted moving average of the hold times in milliseconds, which holders
+  //! update when releasing the lock (the last one wins between concurrent holders) so that goldilocks
+  //! about to get in line can predict how long they would wait (goldilock --max-expected-wait).
+  struct hold_time_estimate {
+
+    //!\brief how much the latest hold time counts in the average
+    static constexpr double weight_of_latest = 0.25;
+
+    static fs::path get_path(const fs::path& lockfile) {
+      return lockfile.parent_path() / (lockfile.filename().generic_string() + ".hold-time"s);
+    }
+
+    //!\brief the current estimate, std::nullopt if nobody recorded a hold time yet
+    static std::optional<std::chrono::milliseconds> read(const fs::path& lockfile) {
+      try {
+        auto content = file::read_file_content(get_path(lockfile));
+        if(!content.empty()) {
+          return std::chrono::milliseconds(std::stoull(content));
+        }
+      }
+      catch(...) {
+        // unreadable or garbage, as good as none
+      }
+
+      return std::nullopt;
+    }
+
+    //!\brief fold the hold time of the lock we're about to release into the estimate
+    static void record(const fs::path& lockfile, std::chrono::milliseconds hold_time) {
+      auto estimate = hold_time;
+
+      if(auto previous = read(lockfile); previous.has_value()) {
+        estimate = std::chrono::milliseconds(std::llround(weight_of_latest * hold_time.count() + (1.0 - weight_of_latest) * previous->count()));
+      }
+
+      file::write_file_permissive(get_path(lockfile), std::to_string(estimate.count()));
+    }
+  };
+
+}
@@ -0,0 +1,139 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <goldilock/string.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::chrono_literals;
+
+  //!\brief how to go about holding several locks at once (goldilock --multi-lock-strategy)
+  enum class multi_lock_strategy {
+    //!\brief one after the other in the order of their canonical paths, keeping what we got meanwhile
+    ordered,
+    //!\brief all at once when first in all the lines, getting back in line after repeated failures
+    reshuffle
+  };
+
+  //!\brief what a lock_backend gets set up with (cf. make_lock_backend())
+  struct lock_backend_options {
+    //!\brief the lockfiles to hold all at once, canonical paths
+    std::vector<fs::path> lockfiles;
+
+    //!\brief how long our place in line stays valid without a heartbeat (cf. goldilock_spot::default_lease)
+    std::chrono::milliseconds lease = 60s;
+
+    //!\brief how often heartbeat() should be called, for the backends that need one
+    std::chrono::milliseconds heartbeat = 15s;
+
+    //!\brief wait in line in a dedicated <lockfile>.q directory (goldilock --queue-dir)
+    bool use_queue_directory = false;
+
+    //!\brief the capacity of each lock, in tokens (goldilock --slots)
+    size_t slots = 1;
+
+    //!\brief how many tokens of each lock's capacity we need (goldilock --tokens)
+    size_t tokens = 1;
+
+    //!\brief hold the locks together with the other shared holders (goldilock --shared)
+    bool shared = false;
+
+    //!\brief the lockfiles are interchangeable, hold whichever we get first (goldilock --any-of)
+    bool any_of = false;
+
+    multi_lock_strategy strategy = multi_lock_strategy::ordered;
+
+    //!\brief go ahead of those with a lower priority in line (goldilock --priority)
+    int priority = 0;
+
+    //!\brief how much waiting in line one level of priority is worth (goldilock --priority-aging)
+    std::chrono::milliseconds priority_aging = 60s;
+
+    //!\brief when we have to be done, go ahead of those that aren't in a hurry (goldilock --deadline)
+    std::optional<std::chrono::system_clock::time_point> deadline;
+
+    //!\brief whose share of the locks we wait for (goldilock --tenant)
+    std::string tenant;
+
+    //!\brief take turns with the other tenants in proportion to this weight, 0 to wait first come first served (goldilock --fair-share)
+    size_t fair_share_weight = 0;
+
+    //!\brief don't get in line behind that many goldilocks already waiting for or holding a lock (goldilock --max-queue-depth)
+    std::optional<size_t> max_queue_depth;
+
+    //!\brief don't get in line if the recorded hold times predict a longer wait (goldilock --max-expected-wait)
+    std::optional<std::chrono::milliseconds> max_expected_wait;
+  };
+
+  //!\brief we'd rather not get in line at all: the queue is too long already (cf. lock_backend::enqueue())
+  struct lock_admission_error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+
+  //!\brief how goldilocks queue up for and mutually exclude each other on a set of locks
+  //!
+  //! The default backend is the queue of spots next to the lockfiles plus the lock on the lockfiles
+  //! themselves (cf. file_lock_backend), the alternatives are selected with --backend. Goldilocks only
+  //! exclude each other when they use the same backend. A goldilock:
+  //!  - calls enqueue() once to get in line
+  //!  - calls acquire_until() until it returns true (waiting in line, then taking the locks)
+  //!  - calls heartbeat() every heartbeat_interval() from another thread meanwhile and while holding the locks
+  //!  - calls release() once done
+  struct lock_backend {
+    virtual ~lock_backend() = default;
+
+    //!\brief get in line for the locks (or take them right away if that's possible)
+    //!\throw lock_admission_error when the admission limits of the options say not to get in line
+    //!
+    //! Backends queueing up as part of acquire_until() don't need to do anything here, acquire_until()
+    //! gets in line on its own if this wasn't called.
+    virtual void enqueue() {}
+
+    //!\brief wait in line for all the locks until we hold them, the deadline passed or cancel got set
+    //!\return true once we hold all the locks, we keep our place in line otherwise
+    //!
+    //! The locks that are free are taken even if the deadline passed already (goldilock --try).
+    virtual bool acquire_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) = 0;
+
+    //!\brief let the others know we're still alive, called concurrently to acquire_until()
+    virtual void heartbeat() {}
+
+    //!\brief how often heartbeat() has to be called, if at all
+    virtual std::optional<std::chrono::milliseconds> heartbeat_interval() const {
+      return std::nullopt;
+    }
+
+    //!\brief which of the lockfiles we hold when we were to pick one of them (cf. lock_backend_options::any_of)
+    virtual std::optional<fs::path> get_chosen_lockfile() const {
+      return std::nullopt;
+    }
+
+    //!\brief release the locks we hold and leave the queues
+    //!
+    //! Also when giving up before holding all of them: the locks we got meanwhile are released too.
+    virtual void release() = 0;
+  };
+
+  //!\brief host wide name of the lock on (canonical) lockfile for backends not using the file itself
+  inline std::string get_lock_key(const fs::path& lockfile) {
+    uint64_t hash = string::fnv1a_64(lockfile.generic_string());
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "goldilock-%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+  }
+
+}
@@ -0,0 +1,54 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/predef.h>
+
+#include <goldilock/lock_backend.hpp>
+#include <goldilock/file_lock_backend.hpp>
+#include <goldilock/shm_lock_backend.hpp>
+#include <goldilock/socket_lock_backend.hpp>
+
+namespace tipi::goldilock {
+
+  using namespace std::string_literals;
+
+  //!\brief the names of the backends available on this platform (goldilock --backend), the default first
+  inline const std::vector<std::string>& available_lock_backends() {
+    static const std::vector<std::string> names = {
+      "file",
+      #if BOOST_OS_LINUX
+      "shm",
+      "socket",
+      #endif
+    };
+
+    return names;
+  }
+
+  //!\brief set up the backend called name (cf. available_lock_backends())
+  inline std::unique_ptr<lock_backend> make_lock_backend(const std::string& name, const lock_backend_options& options, std::ostream& log) {
+    if(name == "file") {
+      return std::make_unique<file_lock_backend>(options, log);
+    }
+
+    #if BOOST_OS_LINUX
+    if(name == "shm") {
+      return std::make_unique<shm_lock_backend>(options.lockfiles);
+    }
+
+    if(name == "socket") {
+      return std::make_unique<socket_lock_backend>(options.lockfiles);
+    }
+    #endif
+
+    throw std::invalid_argument("Unsupported lock backend '"s + name + "'"s);
+  }
+
+}
@@ -0,0 +1,188 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#else
+#include <boost/interprocess/sync/file_lock.hpp>
+#endif
+
+namespace tipi::goldilock {
+
+  using namespace std::string_literals;
+  using namespace std::chrono_literals;
+
+  //!\brief the exclusive lock on a lockfile, which can be waited for with a deadline and cancelled
+  //!
+  //! On linux this is an open file description lock (F_OFD_SETLK) on the whole file, which conflicts
+  //! with the fcntl() locks of boost::interprocess::file_lock that other (older) goldilocks hold and
+  //! unlike those isn't dropped when any other descriptor of the file gets closed by the process.
+  //! Waiting happens in F_OFD_SETLKW so that the kernel wakes us up the moment the previous holder
+  //! lets go. Elsewhere it's a boost::interprocess::file_lock polled until the deadline.
+  //!
+  //! A shared lockfile_lock can be held by several goldilocks at the same time (cf. --slots) but
+  //! never alongside an exclusive one.
+  struct lockfile_lock {
+
+    explicit lockfile_lock(const char *path, bool shared = false)
+      : shared_{shared}
+    #if !BOOST_OS_LINUX
+      , lock_{path}
+    #endif
+    {
+      #if BOOST_OS_LINUX
+      fd_ = ::open(path, O_RDWR | O_CLOEXEC);
+      if(fd_ < 0) {
+        throw std::runtime_error("Could not open lockfile "s + path + ": "s + std::strerror(errno));
+      }
+      #endif
+    }
+
+    ~lockfile_lock() {
+      #if BOOST_OS_LINUX
+      ::close(fd_);  // releases the lock too
+      #endif
+    }
+
+    lockfile_lock(const lockfile_lock&) = delete;
+    lockfile_lock& operator=(const lockfile_lock&) = delete;
+
+    bool try_lock() {
+      #if BOOST_OS_LINUX
+      struct flock fl = whole_file(lock_type());
+      return ::fcntl(fd_, F_OFD_SETLK, &fl) == 0;
+      #else
+      return shared_ ? lock_.try_lock_sharable() : lock_.try_lock();
+      #endif
+    }
+
+    //!\brief wait for the lock until deadline, or until cancel gets set
+    //!\return true if we hold the lock
+    bool lock_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) {
+      if(try_lock()) {
+        return true;
+      }
+
+      #if BOOST_OS_LINUX
+      // the blocking wait happens on a helper thread so that we can keep an eye on the deadline and
+      // on cancel here and interrupt it with a signal (EINTR) if we have to give up
+      install_interrupt_handler();
+
+      std::mutex mut;
+      std::condition_variable cv;
+      bool done = false;
+      bool acquired = false;
+      std::atomic_bool abandoned = false;
+
+      std::thread waiter([&]() {
+        struct flock fl = whole_file(lock_type());
+        int ret = -1;
+
+        while(!abandoned && (ret = ::fcntl(fd_, F_OFD_SETLKW, &fl)) != 0 && errno == EINTR) {}
+
+        std::unique_lock<std::mutex> lock(mut);
+        done = true;
+        acquired = (ret == 0);
+        cv.notify_all();
+      });
+
+      std::unique_lock<std::mutex> lock(mut);
+
+      while(!done && !cancel && std::chrono::steady_clock::now() < deadline) {
+        cv.wait_until(lock, std::min(deadline, std::chrono::steady_clock::now() + 50ms));  // cancel isn't notified
+      }
+
+      // give up: interrupt the waiter until it notices (the signal could hit it right before it blocks)
+      abandoned = true;
+      while(!done) {
+        pthread_kill(waiter.native_handle(), interrupt_signal);
+        cv.wait_for(lock, 1ms);
+      }
+
+      lock.unlock();
+      waiter.join();
+      return acquired;
+      #else
+      while(!cancel && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(10ms);
+
+        if(try_lock()) {
+          return true;
+        }
+      }
+
+      return false;
+      #endif
+    }
+
+    void unlock() {
+      #if BOOST_OS_LINUX
+      struct flock fl = whole_file(F_UNLCK);
+      ::fcntl(fd_, F_OFD_SETLK, &fl);
+      #else
+      if(shared_) {
+        lock_.unlock_sharable();
+      }
+      else {
+        lock_.unlock();
+      }
+      #endif
+    }
+
+  private:
+    bool shared_ = false;
+
+    #if BOOST_OS_LINUX
+    short lock_type() const {
+      return shared_ ? F_RDLCK : F_WRLCK;
+    }
+
+    //!\brief delivered to the waiting thread to get it out of F_OFD_SETLKW (ignored by default anyway)
+    static constexpr int interrupt_signal = SIGURG;
+
+    static struct flock whole_file(short type) {
+      struct flock fl{};
+      fl.l_type = type;
+      fl.l_whence = SEEK_SET;
+      fl.l_start = 0;
+      fl.l_len = 0;
+      fl.l_pid = 0;
+      return fl;
+    }
+
+    //!\brief a handler that does nothing, installed without SA_RESTART so that blocking calls return EINTR
+    static void install_interrupt_handler() {
+      static std::once_flag installed;
+      std::call_once(installed, []() {
+        struct sigaction action{};
+        action.sa_handler = [](int) {};
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = 0;
+        sigaction(interrupt_signal, &action, nullptr);
+      });
+    }
+
+    int fd_ = -1;
+    #else
+    boost::interprocess::file_lock lock_;
+    #endif
+  };
+
+}
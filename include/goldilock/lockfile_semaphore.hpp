@@ -0,0 +1,141 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <goldilock/file.hpp>
+#include <goldilock/lockfile_lock.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::string_literals;
+  using namespace std::chrono_literals;
+
+  //!\brief the lock on a lockfile with a capacity of slots units, of which we hold tokens (goldilock --slots / --tokens)
+  //!
+  //! With a single slot that's just the lockfile_lock on the lockfile, exclusive unless we only want to
+  //! share it with other shared holders (goldilock --shared). With more slots, holders
+  //! take a shared lock on the lockfile, so that they still exclude goldilocks holding it exclusively,
+  //! plus the exclusive locks on tokens of the <lockfile>.slot-<k> files next to it. We never hold
+  //! only some of those while waiting, so that waiters can't block each other with partial holds.
+  struct lockfile_semaphore {
+
+    lockfile_semaphore(const fs::path& lockfile, size_t slots, size_t tokens = 1, bool shared = false)
+      : slots_{std::max<size_t>(slots, 1)}
+      , tokens_{std::clamp<size_t>(tokens, 1, slots_)}
+      , lockfile_lock_{lockfile.generic_string().data(), slots_ > 1 || shared}
+    {
+      if(slots_ > 1) {
+        for(size_t slot = 0; slot < slots_; slot++) {
+          std::string slot_path = get_slot_path(lockfile, slot).generic_string();
+          file::touch_file_permissive(slot_path);
+          slot_locks_.push_back(std::make_unique<lockfile_lock>(slot_path.data()));
+        }
+      }
+    }
+
+    lockfile_semaphore(const lockfile_semaphore&) = delete;
+    lockfile_semaphore& operator=(const lockfile_semaphore&) = delete;
+
+    //!\brief path of the file backing slot of lockfile
+    static fs::path get_slot_path(const fs::path& lockfile, size_t slot) {
+      return lockfile.parent_path() / (lockfile.filename().generic_string() + ".slot-"s + std::to_string(slot));
+    }
+
+    bool try_lock() {
+      if(!lockfile_lock_.try_lock()) {
+        return false;
+      }
+
+      if(slots_ == 1 || try_take_slots()) {
+        return true;
+      }
+
+      lockfile_lock_.unlock();
+      return false;
+    }
+
+    //!\brief wait for our tokens until deadline, or until cancel gets set
+    //!\return true if we hold them
+    bool lock_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) {
+      if(!lockfile_lock_.lock_until(deadline, cancel)) {
+        return false;
+      }
+
+      if(slots_ == 1) {
+        return true;
+      }
+
+      // wait in the kernel on one slot after the other, whichever gets released in the meantime is
+      // found by the next try_take_slots() (tried at least once, even with the deadline passed already)
+      for(size_t attempt = 0; ; attempt++) {
+        if(try_take_slots()) {
+          return true;
+        }
+
+        if(cancel || std::chrono::steady_clock::now() >= deadline) {
+          break;
+        }
+
+        size_t slot = attempt % slots_;
+        if(slot_locks_[slot]->lock_until(std::min(deadline, std::chrono::steady_clock::now() + 50ms), cancel)) {
+          held_slots_.push_back(slot);
+
+          if(try_take_slots()) {
+            return true;
+          }
+        }
+      }
+
+      // don't keep exclusive goldilocks out while we don't hold a slot
+      lockfile_lock_.unlock();
+      return false;
+    }
+
+    void unlock() {
+      release_slots();
+      lockfile_lock_.unlock();
+    }
+
+  private:
+    //!\brief complete the slots we hold to tokens_ of them, all or nothing
+    bool try_take_slots() {
+      for(size_t slot = 0; slot < slots_ && held_slots_.size() < tokens_; slot++) {
+        if(std::find(held_slots_.begin(), held_slots_.end(), slot) == held_slots_.end() && slot_locks_[slot]->try_lock()) {
+          held_slots_.push_back(slot);
+        }
+      }
+
+      if(held_slots_.size() == tokens_) {
+        return true;
+      }
+
+      release_slots();
+      return false;
+    }
+
+    void release_slots() {
+      for(auto slot : held_slots_) {
+        slot_locks_[slot]->unlock();
+      }
+
+      held_slots_.clear();
+    }
+
+    size_t slots_;
+    size_t tokens_;
+    lockfile_lock lockfile_lock_;
+    std::vector<std::unique_ptr<lockfile_lock>> slot_locks_;
+    std::vector<size_t> held_slots_;
+  };
+
+}
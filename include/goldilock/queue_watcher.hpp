@@ -0,0 +1,231 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#endif
+
+#include <goldilock/goldilock_spot.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::chrono_literals;
+
+  //!\brief wait for the spot queues of a set of lockfiles to change
+  //!
+  //! On linux this blocks on inotify events of the directories holding the spots so
+  //! that a waiter wakes up as soon as a spot gets created, removed or (re)written.
+  //! Elsewhere, when inotify_add_watch() fails, or when a directory is on a network or
+  //! FUSE filesystem (where the watch succeeds but changes made by other hosts never
+  //! show up as events), wait_for_change() degrades to a plain sleep.
+  //! Meanwhile it counts the spots leaving the queues, cf. take_departures().
+  struct queue_watcher {
+
+    queue_watcher() {
+      #if BOOST_OS_LINUX
+      inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      #endif
+    }
+
+    ~queue_watcher() {
+      #if BOOST_OS_LINUX
+      if(inotify_fd_ >= 0) {
+        close(inotify_fd_);
+      }
+      #endif
+    }
+
+    queue_watcher(const queue_watcher&) = delete;
+    queue_watcher& operator=(const queue_watcher&) = delete;
+
+    //!\brief start watching the queue of spots for lockfile (canonical path expected)
+    void watch(const fs::path& lockfile) {
+      fs::path directory = get_lockfile_queue_directory(lockfile);
+      watched_lockfiles_[lockfile] = directory;
+
+      #if BOOST_OS_LINUX
+      if(inotify_fd_ < 0) {
+        return;
+      }
+
+      for(const auto& [wd, watched_dir] : watched_directories_) {
+        if(watched_dir == directory) {
+          return;
+        }
+      }
+
+      int wd = is_local_filesystem(directory)
+        ? inotify_add_watch(inotify_fd_, directory.generic_string().data(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE)
+        : -1;
+
+      if(wd < 0) {
+        // this filesystem won't tell us about changes, poll everything
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+        watched_directories_.clear();
+        return;
+      }
+
+      watched_directories_[wd] = directory;
+      #endif
+    }
+
+    //!\brief true if changes are notified by the kernel, false if we're (just) polling
+    bool is_event_driven() const {
+      #if BOOST_OS_LINUX
+      return inotify_fd_ >= 0 && !watched_directories_.empty();
+      #else
+      return false;
+      #endif
+    }
+
+    //!\brief how many spots left the watched queues during the calls to wait_for_change() since the
+    //! last call, as far as we know: with lost events that's everyone (and 0 without events at all)
+    size_t take_departures() {
+      size_t departures = departures_;
+      departures_ = 0;
+      return departures;
+    }
+
+    //!\brief block until one of the watched queues changed or the timeout expired
+    //!\return true if a change to a spot was observed, false on timeout
+    bool wait_for_change(std::chrono::milliseconds timeout) {
+
+      #if BOOST_OS_LINUX
+      if(is_event_driven()) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        while(true) {
+          if(drain_events()) {
+            return true;
+          }
+
+          auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+          if(remaining.count() <= 0) {
+            return false;
+          }
+
+          pollfd pfd{ inotify_fd_, POLLIN, 0 };
+          int ret = poll(&pfd, 1, static_cast<int>(remaining.count()));
+
+          if(ret < 0 && errno != EINTR) {
+            // can't rely on the notifications anymore...
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+            watched_directories_.clear();
+            break;
+          }
+        }
+      }
+      #endif
+
+      std::this_thread::sleep_for(timeout);
+      return false;
+    }
+
+  private:
+
+    #if BOOST_OS_LINUX
+    //!\brief false for the filesystems on which only the changes made by this host are notified
+    static bool is_local_filesystem(const fs::path& directory) {
+      // linux/magic.h of older kernels lacks some of them
+      static constexpr std::array<uint32_t, 10> remote_filesystems = {
+        0x6969,       // NFS_SUPER_MAGIC
+        0x517B,       // SMB_SUPER_MAGIC
+        0xFE534D42,   // SMB2_MAGIC_NUMBER
+        0xFF534D42,   // CIFS_MAGIC_NUMBER
+        0x65735546,   // FUSE_SUPER_MAGIC (sshfs, s3fs, ...)
+        0x01021997,   // V9FS_MAGIC
+        0x00C36400,   // CEPH_SUPER_MAGIC
+        0x5346414F,   // AFS_SUPER_MAGIC
+        0x0BD00BD0,   // LUSTRE_SUPER_MAGIC
+        0x47504653    // GPFS_SUPER_MAGIC
+      };
+
+      struct statfs st;
+      if(statfs(directory.generic_string().data(), &st) != 0) {
+        return true;  // inotify_add_watch() tells
+      }
+
+      return std::find(remote_filesystems.begin(), remote_filesystems.end(), static_cast<uint32_t>(st.f_type)) == remote_filesystems.end();
+    }
+
+    //!\brief read all pending events and tell if any of them concern a spot of a watched lockfile
+    bool drain_events() {
+      alignas(inotify_event) std::array<char, 4096> buffer;
+      bool relevant = false;
+
+      while(true) {
+        ssize_t len = read(inotify_fd_, buffer.data(), buffer.size());
+        if(len <= 0) {
+          break;
+        }
+
+        for(char *ptr = buffer.data(); ptr < buffer.data() + len; ) {
+          const inotify_event *event = reinterpret_cast<const inotify_event *>(ptr);
+          ptr += sizeof(inotify_event) + event->len;
+
+          if(event->mask & IN_Q_OVERFLOW) {
+            relevant = true;  // we lost events... assume the worst
+            departures_ = std::numeric_limits<size_t>::max();
+            continue;
+          }
+
+          if(event->mask & IN_IGNORED) {
+            // the directory went away, nothing more to expect from that one
+            watched_directories_.erase(event->wd);
+            relevant = true;
+            departures_ = std::numeric_limits<size_t>::max();
+            continue;
+          }
+
+          if(event->len == 0 || watched_directories_.find(event->wd) == watched_directories_.end()) {
+            continue;
+          }
+
+          fs::path changed_path = watched_directories_.at(event->wd) / event->name;
+          for(const auto& [lockfile, directory] : watched_lockfiles_) {
+            if(directory == changed_path.parent_path() && extract_lockfile_spot_index(lockfile, changed_path).has_value()) {
+              relevant = true;
+
+              if((event->mask & (IN_DELETE | IN_MOVED_FROM)) && departures_ < std::numeric_limits<size_t>::max()) {
+                departures_++;
+              }
+              break;
+            }
+          }
+        }
+      }
+
+      return relevant;
+    }
+
+    int inotify_fd_ = -1;
+    std::map<int, fs::path> watched_directories_;
+    #endif
+
+    //!\brief lockfile -> directory holding its spots
+    std::map<fs::path, fs::path> watched_lockfiles_;
+
+    size_t departures_ = 0;
+  };
+
+}
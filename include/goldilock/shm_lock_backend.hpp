@@ -0,0 +1,303 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <goldilock/lock_backend.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::string_literals;
+  using namespace std::chrono_literals;
+
+  //!\brief same host locking through robust, priority inheriting mutexes in named shared memory (goldilock --backend shm)
+  //!
+  //! Every lockfile maps to a shared memory segment (/dev/shm/goldilock-<hash of the canonical lockfile path>)
+  //! holding a process shared pthread mutex, the lockfile itself is never touched. The mutexes are:
+  //!  - robust: when a holder dies the next in line gets EOWNERDEAD and takes over right away
+  //!  - PTHREAD_PRIO_INHERIT: the kernel queues the waiters (FUTEX_LOCK_PI) and hands the mutex over
+  //!    to the first one on unlock, so goldilocks of the same priority get the lock first come first served
+  //!
+  //! Acquiring and releasing are a few microseconds uncontended, waking up the next in line is done by
+  //! the kernel. The segments stay around until reboot (or until removed from /dev/shm).
+  struct shm_lock_backend : lock_backend {
+
+    explicit shm_lock_backend(const std::vector<fs::path>& lockfiles)
+      : state_{std::make_shared<shared_state>()}
+    {
+      // always taking the mutexes in the same order avoids deadlocks between goldilocks holding several
+      std::set<std::string> segment_names;
+      for(const auto& lockfile : lockfiles) {
+        segment_names.insert(get_segment_name(lockfile));
+      }
+
+      for(const auto& name : segment_names) {
+        state_->segments.push_back(std::make_shared<mapped_segment>(name));
+      }
+    }
+
+    ~shm_lock_backend() override {
+      release();
+    }
+
+    bool acquire_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) override {
+      // pthread mutexes belong to the thread that locked them: a dedicated thread waits for them in the
+      // kernel, holds them for us and unlocks them when asked to (while we keep an eye on cancel here)
+      if(!owner_thread_.joinable()) {
+        owner_thread_ = std::thread(&shm_lock_backend::hold_mutexes, state_);
+      }
+
+      std::unique_lock<std::mutex> lock(state_->mut);
+
+      while(!state_->acquired && !state_->error && !cancel && std::chrono::steady_clock::now() < deadline) {
+        state_->cv.wait_until(lock, std::min(deadline, std::chrono::steady_clock::now() + 50ms));  // cancel isn't notified
+      }
+
+      if(state_->error) {
+        throw std::runtime_error(state_->error.value());
+      }
+
+      return state_->acquired;
+    }
+
+    void release() override {
+      if(!owner_thread_.joinable()) {
+        return;
+      }
+
+      bool done_waiting = false;
+      {
+        std::unique_lock<std::mutex> lock(state_->mut);
+        state_->release_requested = true;
+        done_waiting = state_->acquired || state_->error.has_value();
+        state_->cv.notify_all();
+      }
+
+      if(done_waiting) {
+        // unlocks what it holds right away
+        owner_thread_.join();
+      }
+      else {
+        // pthread_mutex_lock() on a PI mutex can't be interrupted: the thread is left waiting in the kernel
+        // (keeping its place in line until we exit) and lets go of the mutexes as soon as it gets them
+        owner_thread_.detach();
+      }
+
+      // a new owner thread for the next acquire_until(), sharing the mapped segments
+      auto segments = state_->segments;
+      state_ = std::make_shared<shared_state>();
+      state_->segments = std::move(segments);
+    }
+
+    //!\brief name of the shared memory segment of lockfile
+    static std::string get_segment_name(const fs::path& lockfile) {
+      return "/"s + get_lock_key(lockfile);
+    }
+
+  private:
+
+    //!\brief what lives in the shared memory segment
+    struct segment_layout {
+      static constexpr uint32_t ready_magic = 0x474c4d58; // "GLMX"
+      static constexpr uint32_t current_version = 1;
+
+      std::atomic<uint32_t> ready;  // ready_magic once initialized by the creator
+      uint32_t version;
+      pthread_mutex_t mutex;
+    };
+
+    struct mapped_segment {
+
+      explicit mapped_segment(const std::string& name) {
+        int fd = ::shm_open(name.data(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if(fd < 0) {
+          throw std::runtime_error("Could not open shared memory segment "s + name + ": "s + std::strerror(errno));
+        }
+
+        bool ok = map_initialized(fd);
+        int map_errno = errno;
+        ::close(fd);
+
+        if(!ok) {
+          unmap();
+          throw std::runtime_error("Could not initialize shared memory segment "s + name + ": "s + std::strerror(map_errno));
+        }
+
+        if(layout_->version != segment_layout::current_version) {
+          unmap();
+          throw std::runtime_error("Shared memory segment "s + name + " was created by an incompatible goldilock version"s);
+        }
+      }
+
+      ~mapped_segment() {
+        unmap();
+      }
+
+      mapped_segment(const mapped_segment&) = delete;
+      mapped_segment& operator=(const mapped_segment&) = delete;
+
+      pthread_mutex_t *mutex() {
+        return &layout_->mutex;
+      }
+
+    private:
+      bool map(int fd) {
+        void *addr = ::mmap(nullptr, sizeof(segment_layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(addr == MAP_FAILED) {
+          return false;
+        }
+
+        layout_ = static_cast<segment_layout *>(addr);
+        return true;
+      }
+
+      void unmap() {
+        if(layout_ != nullptr) {
+          ::munmap(layout_, sizeof(segment_layout));
+          layout_ = nullptr;
+        }
+      }
+
+      //!\brief map the segment in fd, initializing it unless someone did already
+      //!
+      //! Whoever initializes the mutex holds an flock() on the segment meanwhile, the others wait for it
+      //! however long that takes (the creator may be stopped, not dead). The kernel drops the flock() when
+      //! the creator dies: the next one to get it finds the segment not ready and initializes it then,
+      //! nobody can have used a mutex that never got ready.
+      bool map_initialized(int fd) {
+        if(is_ready(fd)) {
+          return true;
+        }
+
+        int ret = 0;
+        while((ret = ::flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+        if(ret != 0) {
+          return false;
+        }
+
+        bool ok = is_ready(fd);
+        if(!ok) {
+          ::fchmod(fd, 0666); // shared between users, whatever the umask (only works for the creator)
+          ok = ::ftruncate(fd, sizeof(segment_layout)) == 0 && (layout_ != nullptr || map(fd)) && initialize();
+        }
+
+        int initialize_errno = errno;
+        ::flock(fd, LOCK_UN);
+        errno = initialize_errno;
+        return ok;
+      }
+
+      //!\brief whether the segment in fd got initialized, mapping it as soon as it has its size
+      bool is_ready(int fd) {
+        struct stat st;
+        if(layout_ == nullptr && ::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(segment_layout)) {
+          map(fd);
+        }
+
+        return layout_ != nullptr && layout_->ready.load(std::memory_order_acquire) == segment_layout::ready_magic;
+      }
+
+      bool initialize() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+        int ret = pthread_mutex_init(&layout_->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        if(ret != 0) {
+          errno = ret;
+          return false;
+        }
+
+        layout_->version = segment_layout::current_version;
+        layout_->ready.store(segment_layout::ready_magic, std::memory_order_release);
+        return true;
+      }
+
+      segment_layout *layout_ = nullptr;
+    };
+
+    //!\brief shared with the thread holding the mutexes
+    struct shared_state {
+      std::vector<std::shared_ptr<mapped_segment>> segments;
+
+      std::mutex mut;
+      std::condition_variable cv;
+      bool acquired = false;
+      bool release_requested = false;
+      std::optional<std::string> error;
+    };
+
+    static void hold_mutexes(std::shared_ptr<shared_state> state) {
+      size_t held = 0;
+      std::optional<std::string> error;
+
+      for(auto& segment : state->segments) {
+        int ret = pthread_mutex_lock(segment->mutex());
+
+        if(ret == EOWNERDEAD) {
+          // the previous holder died holding it, the lock is ours now
+          pthread_mutex_consistent(segment->mutex());
+          ret = 0;
+        }
+
+        if(ret != 0) {
+          error = "Could not lock shared memory mutex: "s + std::strerror(ret);
+          break;
+        }
+
+        held++;
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(state->mut);
+        state->acquired = !error.has_value();
+        state->error = error;
+        state->cv.notify_all();
+
+        state->cv.wait(lock, [&]() { return state->release_requested || error.has_value(); });
+      }
+
+      while(held > 0) {
+        pthread_mutex_unlock(state->segments[--held]->mutex());
+      }
+    }
+
+    std::shared_ptr<shared_state> state_;
+    std::thread owner_thread_;
+  };
+
+}
+
+#endif
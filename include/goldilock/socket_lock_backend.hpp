@@ -0,0 +1,180 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <goldilock/lock_backend.hpp>
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+  using namespace std::string_literals;
+  using namespace std::chrono_literals;
+
+  //!\brief locking through abstract unix sockets (goldilock --backend socket)
+  //!
+  //! Holding the lock on a lockfile means having bound the abstract socket "\0goldilock-<hash of the
+  //! canonical lockfile path>": the kernel grants the name to a single socket and frees it the moment
+  //! that socket gets closed, the holder dying included. No file is involved at all, so this works on
+  //! read-only or slow filesystems, between all processes sharing the network namespace.
+  //!
+  //! Waiters connect to the holder's socket and sleep until the connection breaks, which happens
+  //! when the holder closes it (the holder never accepts, pending connections get reset), and then
+  //! race for the name. There's no first come first served ordering with this backend.
+  struct socket_lock_backend : lock_backend {
+
+    explicit socket_lock_backend(const std::vector<fs::path>& lockfiles) {
+      // always taking the names in the same order avoids deadlocks between goldilocks holding several
+      std::set<std::string> keys;
+      for(const auto& lockfile : lockfiles) {
+        keys.insert(get_lock_key(lockfile));
+      }
+
+      for(const auto& key : keys) {
+        locks_.push_back(socket_lock{ make_address(key), -1 });
+      }
+    }
+
+    ~socket_lock_backend() override {
+      release();
+    }
+
+    bool acquire_until(std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) override {
+      for(auto& lock : locks_) {
+        while(lock.listening_fd < 0) {
+          if(try_bind(lock)) {
+            break;
+          }
+
+          if(cancel || std::chrono::steady_clock::now() >= deadline) {
+            return false;
+          }
+
+          wait_for_holder(lock, deadline, cancel);
+        }
+      }
+
+      return true;
+    }
+
+    void release() override {
+      for(auto it = locks_.rbegin(); it != locks_.rend(); ++it) {
+        if(it->listening_fd >= 0) {
+          ::close(it->listening_fd);
+          it->listening_fd = -1;
+        }
+      }
+    }
+
+  private:
+    struct socket_lock {
+      sockaddr_un address;
+      int listening_fd;
+    };
+
+    static sockaddr_un make_address(const std::string& key) {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      // abstract namespace: leading NUL byte, the name is the rest of the address (not NUL terminated)
+      std::memcpy(address.sun_path + 1, key.data(), std::min(key.size(), sizeof(address.sun_path) - 1));
+      return address;
+    }
+
+    static socklen_t address_length(const sockaddr_un& address) {
+      return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + std::strlen(address.sun_path + 1));
+    }
+
+    static bool try_bind(socket_lock& lock) {
+      int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if(fd < 0) {
+        throw std::runtime_error("Could not create socket: "s + std::strerror(errno));
+      }
+
+      if(::bind(fd, reinterpret_cast<const sockaddr *>(&lock.address), address_length(lock.address)) != 0) {
+        int bind_errno = errno;
+        ::close(fd);
+
+        if(bind_errno == EADDRINUSE) {
+          return false;
+        }
+
+        throw std::runtime_error("Could not bind lock socket: "s + std::strerror(bind_errno));
+      }
+
+      // the waiters' connections pile up in the backlog, we never accept them
+      if(::listen(fd, SOMAXCONN) != 0) {
+        int listen_errno = errno;
+        ::close(fd);
+        throw std::runtime_error("Could not listen on lock socket: "s + std::strerror(listen_errno));
+      }
+
+      lock.listening_fd = fd;
+      return true;
+    }
+
+    //!\brief sleep until the holder of lock lets go of it (or might have), the deadline passed or cancel got set
+    static void wait_for_holder(const socket_lock& lock, std::chrono::steady_clock::time_point deadline, const std::atomic_bool& cancel) {
+      int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+      if(fd < 0) {
+        throw std::runtime_error("Could not create socket: "s + std::strerror(errno));
+      }
+
+      if(::connect(fd, reinterpret_cast<const sockaddr *>(&lock.address), address_length(lock.address)) != 0) {
+        int connect_errno = errno;
+        ::close(fd);
+
+        // the holder's backlog is full: poll instead
+        if(connect_errno == EAGAIN) {
+          std::this_thread::sleep_for(10ms);
+        }
+
+        // ECONNREFUSED: released already (or bound but not listening yet), try again right away
+        return;
+      }
+
+      while(!cancel) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if(remaining.count() <= 0) {
+          break;
+        }
+
+        pollfd pfd{ fd, POLLIN, 0 };
+        int ret = ::poll(&pfd, 1, static_cast<int>(std::min<std::chrono::milliseconds>(remaining, 50ms).count()));  // cancel isn't notified
+
+        // the connection breaks (reset or EOF) when the holder closes its socket
+        if(ret > 0 || (ret < 0 && errno != EINTR)) {
+          break;
+        }
+      }
+
+      ::close(fd);
+    }
+
+    std::vector<socket_lock> locks_;
+  };
+
+}
+
+#endif
@@ -0,0 +1,263 @@
+// Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
+// SPDX-License-Identifier: GPL-2.0-only OR Proprietary
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/predef.h>
+#include <boost/uuid/uuid.hpp>
+
+#include <goldilock/string.hpp>
+
+#if !BOOST_OS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace tipi::goldilock {
+
+  namespace fs = boost::filesystem;
+
+  //!\brief fixed size binary on-disk representation of a goldilock_spot
+  //!
+  //! Layout (all integers little endian):
+  //!
+  //!   [0..4)    magic "GLSP"
+  //!   [4..6)    format version
+  //!   [6..8)    record length in bytes, checksum included
+  //!   [8..16)   timestamp (milliseconds since epoch)
+  //!   [16..32)  guid
+  //!   [32..36)  flags (cf. flag_*)
+  //!   [36..40)  lease of the owner in milliseconds
+  //!   [40..44)  tokens the owner needs out of the lock's capacity
+  //!   [44..52)  request timestamp of a multi-lock owner (milliseconds since epoch)
+  //!   [52..56)  priority of the owner, signed
+  //!   [56..64)  rank of the spot in line, signed milliseconds since epoch
+  //!   [64..72)  deadline of the owner, milliseconds since epoch, 0 for none
+  //!   [72..80)  tenant of the owner, FNV-1a hash of its name
+  //!   [80..88)  fair share start of the spot, signed milliseconds since epoch, 0 for none
+  //!   [88..92)  FNV-1a checksum of all preceding bytes
+  //!
+  //! Later versions may only append fields before the checksum, so that any reader can
+  //! validate the record from its length and pick the fields it knows about.
+  //!
+  //! goldilocks predating this format couldn't read it: it is only ever written to spot files
+  //! they don't look at, cf. spot_file_suffix.
+  struct spot_record {
+    static constexpr std::array<char, 4> magic{ 'G', 'L', 'S', 'P' };
+    static constexpr uint16_t current_version = 1;
+    static constexpr size_t header_size = 8;
+    static constexpr size_t size = 92;
+
+    //!\brief the owner holds an exclusive flock() on the spot file as long as it is alive
+    static constexpr uint32_t flag_owner_holds_flock = 1u << 0;
+
+    //!\brief the owner wants the lock shared with other shared owners (goldilock --shared)
+    static constexpr uint32_t flag_shared = 1u << 1;
+
+    //!\brief the owner waits in several lines at once and keeps its place in them when it can't get
+    //! all the locks, unless it has to give way to an older such owner (cf. request_timestamp)
+    static constexpr uint32_t flag_multi_lock = 1u << 2;
+
+    //!\brief upper bound of what we read from disk, records from future versions included
+    static constexpr size_t max_size = 512;
+
+    uint64_t timestamp = 0;
+    boost::uuids::uuid guid{};
+    uint32_t flags = 0;
+
+    //!\brief how long the spot stays valid after a heartbeat, 0 if the owner didn't say
+    uint32_t lease_ms = 0;
+
+    //!\brief units of the lock's capacity the owner holds once it gets the lock (goldilock --tokens)
+    uint32_t tokens = 1;
+
+    //!\brief when a flag_multi_lock owner first asked for its locks, kept when it gets back in line
+    uint64_t request_timestamp = 0;
+
+    //!\brief goldilock --priority of the owner
+    int32_t priority = 0;
+
+    //!\brief the lower the further ahead in line once priorities or deadlines are involved: when the
+    //! owner got in line, moved ahead by its priority and deadline (cf. goldilock_spot::is_ahead_of())
+    int64_t rank = 0;
+
+    //!\brief goldilock --deadline of the owner, 0 if it has none
+    uint64_t deadline = 0;
+
+    //!\brief goldilock --tenant of the owner, cf. get_tenant_key()
+    uint64_t tenant = 0;
+
+    //!\brief where the spot starts in line among those of its tenant taking part in the fair share
+    //! (goldilock --fair-share, cf. goldilock_spot::get_in_line()), 0 if the owner doesn't
+    int64_t fair_share_start = 0;
+
+    using buffer_t = std::array<unsigned char, size>;
+
+    buffer_t encode() const {
+      buffer_t buffer{};
+      std::memcpy(buffer.data(), magic.data(), magic.size());
+      put_le(buffer.data() + 4, current_version, 2);
+      put_le(buffer.data() + 6, size, 2);
+      put_le(buffer.data() + 8, timestamp, 8);
+      std::memcpy(buffer.data() + 16, guid.data, guid.size());
+      put_le(buffer.data() + 32, flags, 4);
+      put_le(buffer.data() + 36, lease_ms, 4);
+      put_le(buffer.data() + 40, tokens, 4);
+      put_le(buffer.data() + 44, request_timestamp, 8);
+      put_le(buffer.data() + 52, static_cast<uint32_t>(priority), 4);
+      put_le(buffer.data() + 56, static_cast<uint64_t>(rank), 8);
+      put_le(buffer.data() + 64, deadline, 8);
+      put_le(buffer.data() + 72, tenant, 8);
+      put_le(buffer.data() + 80, static_cast<uint64_t>(fair_share_start), 8);
+      put_le(buffer.data() + size - 4, checksum(buffer.data(), size - 4), 4);
+      return buffer;
+    }
+
+    //!\brief true if data starts like a binary record (as opposed to a legacy text archive)
+    static bool has_magic(const unsigned char *data, size_t len) {
+      return len >= magic.size() && std::memcmp(data, magic.data(), magic.size()) == 0;
+    }
+
+    //!\brief decode and validate a record, std::nullopt if it is torn, corrupted or unknown
+    static std::optional<spot_record> decode(const unsigned char *data, size_t len) {
+      if(len < header_size || !has_magic(data, len)) {
+        return std::nullopt;
+      }
+
+      uint16_t version = static_cast<uint16_t>(get_le(data + 4, 2));
+      size_t record_length = static_cast<size_t>(get_le(data + 6, 2));
+
+      if(version < 1 || record_length < size || record_length != len) {
+        return std::nullopt;
+      }
+
+      if(get_le(data + record_length - 4, 4) != checksum(data, record_length - 4)) {
+        return std::nullopt;
+      }
+
+      spot_record result;
+      result.timestamp = get_le(data + 8, 8);
+      std::memcpy(result.guid.data, data + 16, result.guid.size());
+      result.flags = static_cast<uint32_t>(get_le(data + 32, 4));
+      result.lease_ms = static_cast<uint32_t>(get_le(data + 36, 4));
+      result.tokens = std::max<uint32_t>(static_cast<uint32_t>(get_le(data + 40, 4)), 1);
+      result.request_timestamp = get_le(data + 44, 8);
+      result.priority = static_cast<int32_t>(static_cast<uint32_t>(get_le(data + 52, 4)));
+      result.rank = static_cast<int64_t>(get_le(data + 56, 8));
+      result.deadline = get_le(data + 64, 8);
+      result.tenant = get_le(data + 72, 8);
+      result.fair_share_start = static_cast<int64_t>(get_le(data + 80, 8));
+
+      return result;
+    }
+
+    //!\brief read the raw contents of a spot file (up to max_size bytes) in one go
+    static std::string read_raw(const fs::path& spot_on_disk) {
+      #if BOOST_OS_WINDOWS
+      std::string result(max_size, '\0');
+
+      std::ifstream ifs(spot_on_disk.generic_string(), std::ios::binary);
+      if(!ifs) {
+        throw std::runtime_error("Could not open spot file: " + spot_on_disk.generic_string());
+      }
+      ifs.read(result.data(), result.size());
+      result.resize(static_cast<size_t>(ifs.gcount()));
+      return result;
+      #else
+      int fd = ::open(spot_on_disk.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd < 0) {
+        throw std::runtime_error("Could not open spot file: " + spot_on_disk.generic_string());
+      }
+
+      auto raw = read_raw(fd);
+      ::close(fd);
+
+      if(!raw) {
+        throw std::runtime_error("Could not read spot file: " + spot_on_disk.generic_string());
+      }
+      return raw.value();
+      #endif
+    }
+
+    #if !BOOST_OS_WINDOWS
+    //!\brief same as read_raw(path) on a spot file that is open already, std::nullopt if reading failed
+    static std::optional<std::string> read_raw(int fd) {
+      std::string result(max_size, '\0');
+
+      ssize_t ret = ::pread(fd, result.data(), result.size(), 0);
+      if(ret < 0) {
+        return std::nullopt;
+      }
+
+      result.resize(static_cast<size_t>(ret));
+      return result;
+    }
+    #endif
+
+    //!\brief replace the record in a spot file without ever truncating it, so that concurrent
+    //! readers see either the previous or the new record but never an empty file (the file
+    //! gets recreated if someone removed it in the meantime)
+    static void overwrite(const fs::path& spot_on_disk, const buffer_t& buffer) {
+      #if BOOST_OS_WINDOWS
+      std::ofstream ofs(spot_on_disk.generic_string(), std::ios::binary | std::ios::in | std::ios::out);
+      if(!ofs.is_open()) {
+        ofs.open(spot_on_disk.generic_string(), std::ios::binary | std::ios::out);
+      }
+      ofs.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+      if(!ofs) {
+        throw std::runtime_error("Could not update spot file: " + spot_on_disk.generic_string());
+      }
+      #else
+      int fd = ::open(spot_on_disk.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+      if(fd < 0) {
+        throw std::runtime_error("Could not open spot file: " + spot_on_disk.generic_string());
+      }
+
+      ssize_t ret = ::pwrite(fd, buffer.data(), buffer.size(), 0);
+      ::close(fd);
+
+      if(ret != static_cast<ssize_t>(buffer.size())) {
+        throw std::runtime_error("Could not update spot file: " + spot_on_disk.generic_string());
+      }
+      #endif
+    }
+
+    //!\brief the key of a tenant name as stored in the records
+    static uint64_t get_tenant_key(const std::string& tenant) {
+      return string::fnv1a_64(tenant);
+    }
+
+  private:
+    static uint32_t checksum(const unsigned char *data, size_t len) {
+      uint32_t hash = 2166136261u;
+      for(size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+    static void put_le(unsigned char *dest, uint64_t value, size_t bytes) {
+      for(size_t i = 0; i < bytes; i++) {
+        dest[i] = static_cast<unsigned char>((value >> (8 * i)) & 0xff);
+      }
+    }
+
+    static uint64_t get_le(const unsigned char *src, size_t bytes) {
+      uint64_t value = 0;
+      for(size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(src[i]) << (8 * i);
+      }
+      return value;
+    }
+  };
+
+}
@@ -3,8 +3,10 @@
 #pragma once
 
 #include <cctype>
+#include <cstdint>
 #include <algorithm>
 #include <string>
+#include <string_view>
 
 namespace tipi::goldilock::string {
   
@@ -42,4 +44,14 @@ namespace tipi::goldilock::string {
   inline std::string& trim(std::string& s, const char* t = ws) {
       return ltrim(rtrim(s, t), t);
   }
+
+  //!\brief 64 bit FNV-1a hash of s, stable across hosts and versions (lock keys, tenant keys)
+  inline uint64_t fnv1a_64(std::string_view s) {
+    uint64_t hash = 14695981039346656037ull;
+    for(char c : s) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 // Copyright 2024 Yannic Staudt, tipi technologies Ltd and the goldilock contributors
 // SPDX-License-Identifier: GPL-2.0-only OR Proprietary
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <thread>
@@ -19,6 +23,8 @@
 #include <boost/thread/mutex.hpp>
 #if BOOST_OS_WINDOWS
 #include <boost/winapi/process.hpp>
+#else
+#include <unistd.h>
 #endif
 
 #include <cxxopts.hpp>
@@ -28,6 +34,7 @@
 #include <goldilock/process_info.hpp>
 #include <goldilock/string.hpp>
 #include <goldilock/goldilock_spot.hpp>
+#include <goldilock/lock_backends.hpp>
 #include <goldilock/version.hpp> // generated by build script - located in binary dir
 #include <goldilock/random.hpp>
 
@@ -40,6 +47,21 @@ namespace tipi::goldilock
 
   inline std::ostream nowhere_sink(0);
 
+  //!\brief what goldilock exits with when it refuses to get in line (--max-queue-depth / --max-expected-wait): EX_TEMPFAIL, try again later or elsewhere
+  constexpr int exit_code_not_admitted = 75;
+
+  //!\brief what goldilock exits with when it gave up waiting for the locks (--try / --acquire-timeout), as timeout(1) does
+  constexpr int exit_code_not_acquired = 124;
+
+  //!\brief whose share of the locks we wait for unless told otherwise (goldilock --tenant): the user running us
+  inline std::string get_default_tenant() {
+    #if BOOST_OS_WINDOWS
+    return "user:"s + boost::this_process::environment()["USERNAME"].to_string();
+    #else
+    return "uid:"s + std::to_string(::getuid());
+    #endif
+  }
+
   #if BOOST_OS_WINDOWS
   // boost process handler to tell windows to create a new console when setting up
   // the new process which is the best equivalent of running a detached process
@@ -78,6 +100,7 @@ namespace tipi::goldilock
         ("v,verbose", "Verbose output", cxxopts::value<bool>()->default_value("false"))
         ("h,help", "Print usage")
         ("l,lockfile", "Lockfile(s) to acquire / release, specify as many as you want", cxxopts::value<std::vector<std::string>>())
+        ("any-of", "Interchangeable lockfiles (comma separated) to use instead of --lockfile: wait in line for all of them and hold whichever is acquired first. The child process gets the acquired one in the GOLDILOCK_ACQUIRED_LOCKFILE environment variable, the --lock-success-marker files contain it", cxxopts::value<std::vector<std::string>>())
         ("unlockfile", "Instead of running a command, have goldilock wait for all the specified unlock files to exist (those files will be deleted on exit)", cxxopts::value<std::vector<std::string>>())
         ("timeout", "In the case of --unlockfile, specify a timeout that should not be exceeded (in seconds, default to 60)", cxxopts::value<size_t>()->default_value("60"))
         ("no-timeout", "Do not timeout when using --unlockfile")
@@ -85,6 +108,23 @@ namespace tipi::goldilock
         ("lock-success-marker", "A marker file to write when all logs got acquired", cxxopts::value<std::vector<std::string>>())
         ("watch-parent-process", "Unlock if the selected parent process exits", cxxopts::value<std::vector<std::string>>())
         ("search-nearest-parent-process", "By default --watch-parent-process looks up for the furthest removed parent process, set this flag to search for the nearest parent instead")
+        ("lease", "How long (in milliseconds) our spots in line stay valid without a heartbeat before others consider them abandoned (goldilocks older than this option always assume 60000)", cxxopts::value<size_t>()->default_value("60000"))
+        ("heartbeat", "Interval (in milliseconds) at which our spots in line are refreshed, defaults to a quarter of --lease", cxxopts::value<size_t>())
+        ("backend", "How goldilocks wait in line for and exclude each other: 'file' (queue of spots next to the lockfiles, works across hosts sharing the filesystem), 'shm' (robust mutexes in shared memory, same host only, linux only) or 'socket' (abstract unix sockets, same network namespace only, no first come first served, linux only). Goldilocks only exclude each other when using the same backend", cxxopts::value<std::string>()->default_value("file"))
+        ("slots", "How many goldilocks may hold the lock(s) at the same time: the first <slots> in line run concurrently, the others wait in first come first served order. Goldilocks using the same lockfile should agree on this", cxxopts::value<size_t>()->default_value("1"))
+        ("tokens", "How many of the --slots of the lock(s) we need, e.g. to share a pool of memory between jobs of different weight. Waiters keep first come first served order, nobody passes a large request waiting for enough tokens to be free", cxxopts::value<size_t>()->default_value("1"))
+        ("shared", "Only exclude goldilocks wanting the lock(s) for themselves (e.g. readers of a cache): consecutive shared goldilocks at the head of the line hold the lock(s) together, the others wait for all of those ahead of them to be done")
+        ("priority", "Go ahead of the goldilocks with a lower priority waiting in line (e.g. 1 for interactive builds, -1 for nightly jobs): each level is worth --priority-aging of waiting, so that nobody gets passed for ever", cxxopts::value<int>()->default_value("0"))
+        ("priority-aging", "How long (in milliseconds) a goldilock has to wait in line to make up for one level of --priority", cxxopts::value<size_t>()->default_value("60000"))
+        ("deadline", "When the command has to be done by (in seconds since epoch, e.g. $(date -d 18:00 +%s)): goldilocks with deadlines take turns earliest deadline first and go ahead of those without, the closer their deadline the further (an hour at most)", cxxopts::value<size_t>())
+        ("tenant", "Whose share of the lock(s) we're waiting for with --fair-share (defaults to the user running goldilock)", cxxopts::value<std::string>())
+        ("fair-share", "Take turns with the other tenants waiting in line with --fair-share instead of first come first served, in proportion to the given weight (e.g. 1): whoever queues up lots of goldilocks first doesn't hold up the others", cxxopts::value<size_t>())
+        ("try", "Only take the lock(s) if that's possible right away, otherwise exit with code 124 without waiting in line")
+        ("acquire-timeout", "Give up waiting for the lock(s) after that many milliseconds: leave the queues, release the locks acquired meanwhile and exit with code 124", cxxopts::value<size_t>())
+        ("max-queue-depth", "Don't get in line if that many goldilocks are in line already for one of the lock(s) (for all of them with --any-of), exit with code 75 right away instead so that the job can go elsewhere", cxxopts::value<size_t>())
+        ("max-expected-wait", "Don't get in line if the hold times recorded by the previous holders predict a longer wait (in milliseconds) for one of the lock(s) (for all of them with --any-of), exit with code 75 right away instead", cxxopts::value<size_t>())
+        ("multi-lock-strategy", "How to hold several --lockfile at once: 'ordered' takes them one after the other in the order of their canonical paths keeping those acquired meanwhile (deadlock free), 'reshuffle' takes them all at once when first in every line and gets back in line after a random pause when that fails repeatedly (older goldilocks)", cxxopts::value<std::string>()->default_value("ordered"))
+        ("queue-dir", "Keep the spots waiting in line for each lockfile in a dedicated <lockfile>.q directory instead of next to the lockfile (once it exists, every goldilock uses that directory)")
         ("version", "Print the version of goldilock")
       ;
 
@@ -107,6 +147,128 @@ namespace tipi::goldilock
       verbose = cli_result.count("verbose") > 0;
       detach = cli_result.count("detach") > 0;
       search_for_nearest_parent_process = cli_result.count("search-nearest-parent-process") > 0;
+      use_queue_directory = cli_result.count("queue-dir") > 0;
+
+      backend = cli_result["backend"].as<std::string>();  // has a default value - cf. above
+
+      const auto& backends = available_lock_backends();
+      if(std::find(backends.begin(), backends.end(), backend) == backends.end()) {
+        valid_cli = false;
+        throw std::invalid_argument("Unsupported --backend '"s + backend + "'"s);
+      }
+
+      slots = cli_result["slots"].as<size_t>();  // has a default value - cf. above
+
+      if(slots == 0) {
+        valid_cli = false;
+        throw std::invalid_argument("--slots must be at least 1");
+      }
+
+      tokens = cli_result["tokens"].as<size_t>();  // has a default value - cf. above
+
+      if(tokens == 0 || tokens > slots) {
+        valid_cli = false;
+        throw std::invalid_argument("--tokens must be between 1 and --slots");
+      }
+
+      shared = cli_result.count("shared") > 0;
+
+      auto strategy_name = cli_result["multi-lock-strategy"].as<std::string>();  // has a default value - cf. above
+      if(strategy_name == "ordered") {
+        strategy = multi_lock_strategy::ordered;
+      }
+      else if(strategy_name == "reshuffle") {
+        strategy = multi_lock_strategy::reshuffle;
+      }
+      else {
+        valid_cli = false;
+        throw std::invalid_argument("Unsupported --multi-lock-strategy '"s + strategy_name + "'"s);
+      }
+
+      if(shared && slots > 1) {
+        valid_cli = false;
+        throw std::invalid_argument("--shared can't be combined with --slots");
+      }
+
+      if((slots > 1 || shared) && backend != "file") {
+        valid_cli = false;
+        throw std::invalid_argument("--slots and --shared are only supported by --backend file");
+      }
+
+      priority = cli_result["priority"].as<int>();  // has a default value - cf. above
+      priority_aging = std::chrono::milliseconds(cli_result["priority-aging"].as<size_t>());  // has a default value - cf. above
+
+      if(priority != 0 && backend != "file") {
+        valid_cli = false;
+        throw std::invalid_argument("--priority is only supported by --backend file");
+      }
+
+      if(cli_result.count("deadline") > 0) {
+        deadline = std::chrono::system_clock::time_point{std::chrono::seconds(cli_result["deadline"].as<size_t>())};
+
+        if(backend != "file") {
+          valid_cli = false;
+          throw std::invalid_argument("--deadline is only supported by --backend file");
+        }
+      }
+
+      tenant = (cli_result.count("tenant") > 0) ? cli_result["tenant"].as<std::string>() : get_default_tenant();
+
+      if(cli_result.count("fair-share") > 0) {
+        fair_share_weight = cli_result["fair-share"].as<size_t>();
+
+        if(fair_share_weight == 0) {
+          valid_cli = false;
+          throw std::invalid_argument("--fair-share weight must be at least 1");
+        }
+
+        if(backend != "file") {
+          valid_cli = false;
+          throw std::invalid_argument("--fair-share is only supported by --backend file");
+        }
+      }
+
+      if(cli_result.count("try") > 0 && cli_result.count("acquire-timeout") > 0) {
+        valid_cli = false;
+        throw std::invalid_argument("--try can't be combined with --acquire-timeout");
+      }
+
+      if(cli_result.count("try") > 0) {
+        acquire_timeout = 0ms;
+      }
+
+      if(cli_result.count("acquire-timeout") > 0) {
+        acquire_timeout = std::chrono::milliseconds(cli_result["acquire-timeout"].as<size_t>());
+      }
+
+      // the thread holding the shm mutexes for us has to wait for them once it tried
+      if(acquire_timeout.has_value() && backend == "shm") {
+        valid_cli = false;
+        throw std::invalid_argument("--try and --acquire-timeout aren't supported by --backend shm");
+      }
+
+      if(cli_result.count("max-queue-depth") > 0) {
+        max_queue_depth = cli_result["max-queue-depth"].as<size_t>();
+
+        if(max_queue_depth.value() == 0) {
+          valid_cli = false;
+          throw std::invalid_argument("--max-queue-depth must be at least 1");
+        }
+      }
+
+      if(cli_result.count("max-expected-wait") > 0) {
+        max_expected_wait = std::chrono::milliseconds(cli_result["max-expected-wait"].as<size_t>());
+      }
+
+      if((max_queue_depth.has_value() || max_expected_wait.has_value()) && backend != "file") {
+        valid_cli = false;
+        throw std::invalid_argument("--max-queue-depth and --max-expected-wait are only supported by --backend file");
+      }
+
+      if(priority_aging.count() == 0) {
+        valid_cli = false;
+        throw std::invalid_argument("--priority-aging must be a positive number of milliseconds");
+      }
 
       run_command_mode = (cli_result.count("unlockfile") == 0); // e.g. there's no unlockfile...
 
@@ -122,10 +284,15 @@ namespace tipi::goldilock
         command_mode_cmd = cli_result.unmatched();
       }
 
-      if(cli_result.count("lockfile") == 0) {
+      if(cli_result.count("lockfile") == 0 && cli_result.count("any-of") == 0) {
         throw std::invalid_argument("You must specify the [lockfile] positional argument");
         valid_cli = false;
       }
+
+      if(cli_result.count("lockfile") > 0 && cli_result.count("any-of") > 0) {
+        valid_cli = false;
+        throw std::invalid_argument("--any-of can't be combined with --lockfile");
+      }
       
       if(cli_result.count("lock-success-marker") > 0) {
         success_markers = cli_result["lock-success-marker"].as<std::vector<std::string>>();
@@ -141,6 +308,16 @@ namespace tipi::goldilock
         lockfiles = cli_result["lockfile"].as<std::vector<std::string>>();
       }
 
+      if(cli_result.count("any-of") > 0) {
+        lockfiles = cli_result["any-of"].as<std::vector<std::string>>();
+        any_of = true;
+
+        if(backend != "file") {
+          valid_cli = false;
+          throw std::invalid_argument("--any-of is only supported by --backend file");
+        }
+      }
+
       if(cli_result.count("unlockfile") > 0) {
         unlockfiles = cli_result["unlockfile"].as<std::vector<std::string>>();
       }
@@ -148,6 +325,19 @@ namespace tipi::goldilock
       unlockfile_notimeout = cli_result.count("no-timeout") > 0;
       unlockfile_timeout = cli_result["timeout"].as<size_t>();  // has a default value - cf. above
 
+      lease = std::chrono::milliseconds(cli_result["lease"].as<size_t>());  // has a default value - cf. above
+      heartbeat = (cli_result.count("heartbeat") > 0) ? std::chrono::milliseconds(cli_result["heartbeat"].as<size_t>()) : lease / 4;
+
+      if(lease.count() == 0 || lease.count() > std::numeric_limits<uint32_t>::max()) {
+        valid_cli = false;
+        throw std::invalid_argument("--lease must be a positive number of milliseconds (up to 2^32 - 1)");
+      }
+
+      if(heartbeat.count() == 0 || heartbeat >= lease) {
+        valid_cli = false;
+        throw std::invalid_argument("--heartbeat must be shorter than --lease (and not 0)");
+      }
+
       valid_cli = true;
     }
 
@@ -168,10 +358,28 @@ namespace tipi::goldilock
     bool run_command_mode = false;
     bool search_for_nearest_parent_process = false;
     bool detach = false;
+    bool use_queue_directory = false;
+    std::string backend = "file";
+    size_t slots = 1;
+    size_t tokens = 1;
+    bool shared = false;
+    bool any_of = false;
+    multi_lock_strategy strategy = multi_lock_strategy::ordered;
+    int priority = 0;
+    std::chrono::milliseconds priority_aging = goldilock_spot::default_priority_aging;
+    std::optional<std::chrono::system_clock::time_point> deadline;
+    std::string tenant;
+    size_t fair_share_weight = 0;
+    std::optional<size_t> max_queue_depth;
+    std::optional<std::chrono::milliseconds> max_expected_wait;
+    std::optional<std::chrono::milliseconds> acquire_timeout;
 
     size_t unlockfile_timeout = 0;
     bool unlockfile_notimeout = false;
 
+    std::chrono::milliseconds lease = goldilock_spot::default_lease;
+    std::chrono::milliseconds heartbeat = goldilock_spot::default_lease / 4;
+
     std::vector<std::string> watch_parent_process_names{};
     bool should_watch_parent_process() {
       return watch_parent_process_names.size() > 0;
@@ -291,6 +499,12 @@ namespace tipi::goldilock
       marker_appeared = fs::exists(temp_file);
 
       if(marker_appeared) {
+        // with --any-of the marker tells which lockfile the detached goldilock holds
+        auto chosen_lockfile = goldilock::file::read_file_content(temp_file);
+        if(!chosen_lockfile.empty()) {
+          std::cout << chosen_lockfile << std::endl;
+        }
+
         fs::remove(temp_file);
         return 0;
       }
@@ -302,36 +516,51 @@ namespace tipi::goldilock
     // normal operations 
     //
 
-    boost::mutex spots_mut;
-    std::map<fs::path, goldilock_spot> spots;
-    std::map<fs::path, boost::interprocess::file_lock> file_locks;
-
-    auto take_lock_spots = [&]() {  
-
-      boost::mutex::scoped_lock scoped_lock(spots_mut);
+    lock_backend_options backend_options;
+    backend_options.lease = options.lease;
+    backend_options.heartbeat = options.heartbeat;
+    backend_options.use_queue_directory = options.use_queue_directory;
+    backend_options.slots = options.slots;
+    backend_options.tokens = options.tokens;
+    backend_options.shared = options.shared;
+    backend_options.any_of = options.any_of;
+    backend_options.strategy = options.strategy;
+    backend_options.priority = options.priority;
+    backend_options.priority_aging = options.priority_aging;
+    backend_options.deadline = options.deadline;
+    backend_options.tenant = options.tenant;
+    backend_options.fair_share_weight = options.fair_share_weight;
+    backend_options.max_queue_depth = options.max_queue_depth;
+    backend_options.max_expected_wait = options.max_expected_wait;
+
+    for(const auto& lock_name : options.lockfiles) {
+      backend_options.lockfiles.push_back(fs::weakly_canonical(fs::path(lock_name)));
+    }
 
-      // take our spots in line and ensure the actual lockfiles are created
-      for(const auto& lock_name : options.lockfiles) {
-        auto lockfile = fs::weakly_canonical(fs::path(lock_name));
-        if(spots.find(lockfile) == spots.end()) {
-          spots.emplace(lockfile, lockfile);
-        }
-        
-        if(file_locks.find(lockfile) == file_locks.end()) {
-          
-          // make sure the lock file exits to start with
-          std::string lockfile_str = lockfile.generic_string();
-          goldilock::file::touch_file_permissive(lockfile_str);
-          file_locks.emplace(lockfile, lockfile_str.data());
+    // how long we wait for the locks at most (--try / --acquire-timeout)
+    std::optional<std::chrono::steady_clock::time_point> acquire_deadline;
+    if(options.acquire_timeout.has_value()) {
+      acquire_deadline = std::chrono::steady_clock::now() + options.acquire_timeout.value();
+    }
 
-        }
-      }
-    };
+    // how we wait in line for the locks, cf. lock_backend
+    std::unique_ptr<lock_backend> backend;
 
-    take_lock_spots();
+    try {
+      backend = make_lock_backend(options.backend, backend_options, log);
+      backend->enqueue();
+    }
+    catch(const lock_admission_error& exc) {
+      std::cerr << "Not admitted: " << exc.what() << std::endl;
+      return exit_code_not_admitted;
+    }
+    catch(const std::exception& exc) {
+      std::cerr << "Fatal: " << exc.what() << std::endl;
+      return 1;
+    }
     
     boost::asio::io_context io;
-    bool exit_requested = false;
+    std::atomic_bool exit_requested = false;
     std::optional<bp::child> child_process;
     
     // handle signals and deal with any running child process in that case
@@ -393,7 +622,7 @@ namespace tipi::goldilock
         watch_parent_timer.async_wait(watch_parent_tick_fn); 
       }
       else {
-        log << "(watch_parent_tick_fn) parent not running or exit_requested (" << std::to_string(exit_requested) << ")" << std::endl;
+        log << "(watch_parent_tick_fn) parent not running or exit_requested (" << std::to_string(exit_requested.load()) << ")" << std::endl;
         exit_requested = true;
         return;
       }       
@@ -440,78 +669,37 @@ namespace tipi::goldilock
       // watch process
       if(!exit_requested) {
         
-        // 
-        {
-          boost::mutex::scoped_lock scoped_lock(spots_mut);
-          for(auto& [target, spot] : spots) {
-            spot.update_spot();
-          }
-        }        
+        backend->heartbeat();
 
         // schedule next interval
-        hold_lock_timer.expires_after(2s);
+        hold_lock_timer.expires_after(backend->heartbeat_interval().value());
         hold_lock_timer.async_wait(hold_lock_tick_fn); 
         log << "(hold_lock_tick_fn) rescheduled" << std::endl;
       }   
     };
 
-    // schedule first run
-    hold_lock_timer.async_wait(hold_lock_tick_fn);
+    // schedule first run (nothing to keep alive for backends without heartbeat)
+    if(backend->heartbeat_interval()) {
+      hold_lock_timer.async_wait(hold_lock_tick_fn);
+    }
 
     bool got_all_locks = false;
-    size_t do_update_counter = 0;
-    size_t failed_all_locks_acquire = 0;
-    size_t failed_all_locks_acquire_limit = tipi::goldilock::random::random_in_range(5, 20); // stay in a kind-of similar range for this so that the re-enqueuing has a larger effect
-
-    while(!got_all_locks && !exit_requested) {
-
-      size_t count_first_in_line = std::count_if(
-        spots.begin(), 
-        spots.end(), 
-        [](const auto& pair) {
-          return pair.second.is_first_in_line();
-        });
-
-      bool all_first_in_line = count_first_in_line == spots.size();
-      bool some_first_in_line = count_first_in_line > 0;
+    bool gave_up = false;
 
-      if(all_first_in_line) {
-        got_all_locks = true;
-        
-        for(auto &[path, lock] : file_locks) {
-          got_all_locks &= lock.try_lock_for(50ms);          
+    try {
+      while(!got_all_locks && !gave_up && !exit_requested) {
+        auto deadline = std::chrono::steady_clock::now() + 500ms;
+        if(acquire_deadline.has_value()) {
+          deadline = std::min(deadline, acquire_deadline.value());
         }
-      }
 
-      if(some_first_in_line && !got_all_locks){
-        failed_all_locks_acquire++;
+        got_all_locks = backend->acquire_until(deadline, exit_requested);
+        gave_up = !got_all_locks && acquire_deadline.has_value() && std::chrono::steady_clock::now() >= acquire_deadline.value();
       }
-
-      // if we didn't manage to aquire the locks a given of times in a row, let's get back line 
-      // so we don't deadlock (especially in cases where someones else got a partial lock)
-      if(failed_all_locks_acquire > failed_all_locks_acquire_limit) { 
-        failed_all_locks_acquire = 0;
-        failed_all_locks_acquire_limit = tipi::goldilock::random::random_in_range(5, 20);
-
-        {
-          boost::mutex::scoped_lock scoped_lock(spots_mut);
-          spots.clear();  // really clear our lock spots here so we don't lock up a spot
-        }
-
-        // back of being in the queue for some random amount of time so others can process, even if everyone was started at the same time
-        auto rand_sleep_duration = tipi::goldilock::random::random_sleep_duration<>(200ms, 2000ms);
-        log << "(aquiring all locks) lock acquisition has failed repeatedly pausing for " << rand_sleep_duration.count() << "ms before getting back in line" << std::endl;
-        std::this_thread::sleep_for(rand_sleep_duration);
-
-        take_lock_spots();
-      }
-
-      if(got_all_locks) {
-        break;
-      }
-
-      do_update_counter++;
-      std::this_thread::sleep_for(100ms);
+    }
+    catch(const std::exception& exc) {
+      std::cerr << "Fatal: " << exc.what() << std::endl;
+      exit_requested = true;
     }
 
     if(exit_requested) {
@@ -519,13 +707,29 @@ namespace tipi::goldilock
       return 1;
     }
 
+    if(gave_up) {
+      // leave every line and let go of the locks we got meanwhile before telling anyone
+      clean_stop_io();
+      backend->release();
+      std::cerr << "Gave up: the lock(s) couldn't be acquired " << (options.acquire_timeout->count() == 0 ? "right away"s : "within "s + std::to_string(options.acquire_timeout->count()) + "ms"s) << std::endl;
+      return exit_code_not_acquired;
+    }
+
     //
     // now we own all the locks either...
     //
 
+    // which of the --any-of lockfiles we got
+    auto chosen_lockfile = backend->get_chosen_lockfile();
+
     if(options.should_write_success_markers()) {
       for(const auto& marker : options.success_markers) {
-        goldilock::file::touch_file_permissive(marker);
+        if(chosen_lockfile) {
+          goldilock::file::write_file_permissive(marker, chosen_lockfile->generic_string());
+        }
+        else {
+          goldilock::file::touch_file_permissive(marker);
+        }
       }
     }    
 
@@ -537,8 +741,13 @@ namespace tipi::goldilock
       std::vector<std::string> prepared_cmd = prepare_command(options.command_mode_cmd);
       log << "(run_command_mode) Starting: " << boost::algorithm::join(prepared_cmd, " ") << std::endl;
       
+      bp::environment child_env = boost::this_process::environment();
+      if(chosen_lockfile) {
+        child_env["GOLDILOCK_ACQUIRED_LOCKFILE"] = chosen_lockfile->generic_string();
+      }
+
       // setup the child process (wire up all i/o as passthrough)
-      child_process = bp::child{io, prepared_cmd, bp::std_out > stdout,  bp::std_err > stderr, bp::std_in < stdin};
+      child_process = bp::child{io, prepared_cmd, child_env, bp::std_out > stdout,  bp::std_err > stderr, bp::std_in < stdin};
 
       try {
         child_process->wait();
@@ -586,6 +795,8 @@ namespace tipi::goldilock
     }
     
     // shutdown everything
+    backend->release();
+
     exit_requested = true;
     hold_lock_timer.cancel();
     watch_parent_timer.cancel();
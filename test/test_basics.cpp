@@ -14,8 +14,12 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/random_generator.hpp>
 #include <boost/scope_exit.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/string.hpp>
 
 #include <test_helpers.hpp>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -273,6 +277,707 @@ namespace goldilock::test {
     BOOST_REQUIRE(boost::regex_search(file_content, boost::regex{"[D]{100}"}));
   }
 
+  BOOST_AUTO_TEST_CASE(goldilock_queue_dir_layout) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+    const std::string unlockfile = (wd / "unlockfile").generic_string();
+    const std::string holder_locked_marker = (wd / "holder_locked.marker").generic_string();
+    const std::string waiter_locked_marker = (wd / "waiter_locked.marker").generic_string();
+
+    std::thread t_holder([&](){ 
+      auto result = run_goldilock_command_in(wd, "--queue-dir", "--lockfile", lockfile, "--unlockfile", unlockfile, "--lock-success-marker", holder_locked_marker);
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    BOOST_REQUIRE(wait_for_file(holder_locked_marker));
+    BOOST_REQUIRE(fs::is_directory(wd / "test.lock.q"));
+
+    // a goldilock without --queue-dir picks up the layout and waits in line there, not next to the lockfile
+    std::thread t_waiter([&](){ 
+      auto result = run_goldilock_command_in(wd, "--lockfile", lockfile, "--lock-success-marker", waiter_locked_marker, "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.q" / "test.lock.0.spot"));
+    BOOST_REQUIRE(!fs::exists(wd / "test.lock.0.spot"));
+    BOOST_REQUIRE(wait_for_file(waiter_locked_marker, 10) == false);
+
+    tipi::goldilock::file::touch_file(unlockfile);
+    BOOST_REQUIRE(wait_for_file(waiter_locked_marker));
+
+    t_holder.join();
+    t_waiter.join();
+  }
+
+  #if !BOOST_OS_WINDOWS
+  BOOST_AUTO_TEST_CASE(goldilock_reclaims_spot_of_killed_waiter) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+    const std::string unlockfile = (wd / "unlockfile").generic_string();
+    const std::string holder_locked_marker = (wd / "holder_locked.marker").generic_string();
+    const std::string waiter_locked_marker = (wd / "waiter_locked.marker").generic_string();
+
+    std::thread t_holder([&](){ 
+      auto result = run_goldilock_command_in(wd, "--lockfile", lockfile, "--unlockfile", unlockfile, "--lock-success-marker", holder_locked_marker);
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    BOOST_REQUIRE(wait_for_file(holder_locked_marker));
+
+    bp::child killed_waiter{
+      host_goldilock_executable_path(), "--lockfile", lockfile, "--", "echo", "never",
+      bp::start_dir=wd, bp::std_out > bp::null, bp::std_err > bp::null
+    };
+
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+
+    // no chance to clean up: the spot stays behind, yet those behind it shouldn't wait for it to expire
+    kill(killed_waiter.native_handle(), SIGKILL);
+    killed_waiter.wait();
+    BOOST_REQUIRE(fs::exists(wd / "test.lock.0.spot"));
+
+    std::thread t_waiter([&](){ 
+      auto result = run_goldilock_command_in(wd, "--lockfile", lockfile, "--lock-success-marker", waiter_locked_marker, "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    // whether it got in line or not, the dead spot doesn't hold it back once the lock is free
+    tipi::goldilock::file::touch_file(unlockfile);
+
+    BOOST_REQUIRE(wait_for_file(waiter_locked_marker));
+    t_holder.join();
+    t_waiter.join();
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_honours_owner_lease) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+    const std::string unlockfile = (wd / "unlockfile").generic_string();
+    const std::string holder_locked_marker = (wd / "holder_locked.marker").generic_string();
+    const std::string frozen_locked_marker = (wd / "frozen_locked.marker").generic_string();
+    const std::string waiter_locked_marker = (wd / "waiter_locked.marker").generic_string();
+
+    std::thread t_holder([&](){ 
+      auto result = run_goldilock_command_in(wd, "--lockfile", lockfile, "--unlockfile", unlockfile, "--lock-success-marker", holder_locked_marker);
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    BOOST_REQUIRE(wait_for_file(holder_locked_marker));
+
+    bp::child frozen_waiter{
+      host_goldilock_executable_path(), "--lockfile", lockfile, "--lease", "500", "--lock-success-marker", frozen_locked_marker, "--", "echo", "done",
+      bp::start_dir=wd, bp::std_out > bp::null, bp::std_err > bp::null
+    };
+
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+
+    // a frozen waiter stops its heartbeat, its spot expires after its own lease and not after the default one
+    kill(frozen_waiter.native_handle(), SIGSTOP);
+    std::this_thread::sleep_for(1s);
+
+    std::thread t_waiter([&](){ 
+      auto result = run_goldilock_command_in(wd, "--lockfile", lockfile, "--lock-success-marker", waiter_locked_marker, "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    // the expired spot got removed and its index taken over by the new waiter...
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+    std::this_thread::sleep_for(200ms);
+    BOOST_REQUIRE(!fs::exists(wd / "test.lock.1.spot"));
+
+    // ...while the frozen one gets back in line behind it once it wakes up
+    kill(frozen_waiter.native_handle(), SIGCONT);
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.1.spot"));
+
+    tipi::goldilock::file::touch_file(unlockfile);
+    BOOST_REQUIRE(wait_for_file(waiter_locked_marker));
+
+    frozen_waiter.wait();
+    BOOST_REQUIRE(frozen_waiter.exit_code() == 0);
+
+    t_holder.join();
+    t_waiter.join();
+  }
+  #endif
+
+  // the spots of goldilocks predating the binary spot records: a boost::serialization text archive
+  struct legacy_spot_fields {
+    size_t timestamp_ = 0;
+    std::string guid_;
+
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int version) {
+      ar &timestamp_;
+      ar &guid_;
+    }
+  };
+
+  BOOST_AUTO_TEST_CASE(goldilock_shares_queues_with_older_versions) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    auto waiter = start_goldilock_holder_in(wd, "waiter", "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+
+    // what an older goldilock does scanning the queue: delete the <lockfile>.<N> it can't parse
+    const boost::regex legacy_spot_rx{"test\\.lock\\.[[:digit:]]+"};
+    for(const auto& entry : fs::directory_iterator(wd)) {
+      if(!boost::regex_match(entry.path().filename().generic_string(), legacy_spot_rx)) {
+        continue;
+      }
+
+      try {
+        legacy_spot_fields fields;
+        std::ifstream ifs(entry.path().generic_string());
+        boost::archive::text_iarchive ia(ifs);
+        ia >> fields;
+      }
+      catch(...) {
+        fs::remove(entry.path());
+      }
+    }
+
+    BOOST_REQUIRE(fs::exists(wd / "test.lock.0.spot"));
+
+    // the other way around, an older goldilock gets in line...
+    {
+      legacy_spot_fields fields{ static_cast<size_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()), "legacy" };
+      std::ofstream ofs((wd / "test.lock.1").generic_string());
+      boost::archive::text_oarchive oa(ofs);
+      oa << fields;
+    }
+
+    // ...and those coming after queue behind it
+    auto late_waiter = start_goldilock_holder_in(wd, "late_waiter", "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.2.spot"));
+
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "waiter.marker"));
+    tipi::goldilock::file::touch_file(wd / "waiter.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "late_waiter.marker", 10) == false);
+
+    fs::remove(wd / "test.lock.1");
+    BOOST_REQUIRE(wait_for_file(wd / "late_waiter.marker"));
+    tipi::goldilock::file::touch_file(wd / "late_waiter.unlock");
+
+    for(auto* h : { &holder, &waiter, &late_waiter }) {
+      h->wait();
+      BOOST_REQUIRE(h->exit_code() == 0);
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_slots_bound_parallelism) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+
+    // two slots: the first two in line hold the lock together...
+    auto first = start_goldilock_holder_in(wd, "first", "--lockfile", lockfile, "--slots", "2");
+    BOOST_REQUIRE(wait_for_file(wd / "first.marker"));
+
+    auto second = start_goldilock_holder_in(wd, "second", "--lockfile", lockfile, "--slots", "2");
+    BOOST_REQUIRE(wait_for_file(wd / "second.marker"));
+
+    // ...the third waits for one of them, and so does a goldilock wanting the lock for itself
+    auto third = start_goldilock_holder_in(wd, "third", "--lockfile", lockfile, "--slots", "2");
+    BOOST_REQUIRE(wait_for_file(wd / "third.marker", 10) == false);
+
+    auto exclusive = start_goldilock_holder_in(wd, "exclusive", "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "exclusive.marker", 10) == false);
+
+    tipi::goldilock::file::touch_file(wd / "first.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "third.marker"));
+    BOOST_REQUIRE(!fs::exists(wd / "exclusive.marker"));
+
+    tipi::goldilock::file::touch_file(wd / "second.unlock");
+    tipi::goldilock::file::touch_file(wd / "third.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "exclusive.marker"));
+    tipi::goldilock::file::touch_file(wd / "exclusive.unlock");
+
+    for(auto* holder : { &first, &second, &third, &exclusive }) {
+      holder->wait();
+      BOOST_REQUIRE(holder->exit_code() == 0);
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_tokens_keep_fifo) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+
+    auto large = start_goldilock_holder_in(wd, "large", "--lockfile", lockfile, "--slots", "4", "--tokens", "3");
+    BOOST_REQUIRE(wait_for_file(wd / "large.marker"));
+
+    // 2 tokens don't fit next to 3 out of 4...
+    auto medium = start_goldilock_holder_in(wd, "medium", "--lockfile", lockfile, "--slots", "4", "--tokens", "2");
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.1.spot"));
+
+    // ...and the single free token isn't given to whoever comes after
+    auto small = start_goldilock_holder_in(wd, "small", "--lockfile", lockfile, "--slots", "4", "--tokens", "1");
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.2.spot"));
+    BOOST_REQUIRE(wait_for_file(wd / "small.marker", 10) == false);
+    BOOST_REQUIRE(!fs::exists(wd / "medium.marker"));
+
+    tipi::goldilock::file::touch_file(wd / "large.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "medium.marker"));
+    BOOST_REQUIRE(wait_for_file(wd / "small.marker"));
+
+    tipi::goldilock::file::touch_file(wd / "medium.unlock");
+    tipi::goldilock::file::touch_file(wd / "small.unlock");
+
+    for(auto* holder : { &large, &medium, &small }) {
+      holder->wait();
+      BOOST_REQUIRE(holder->exit_code() == 0);
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_shared_readers_run_together) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+
+    auto first_reader = start_goldilock_holder_in(wd, "first_reader", "--lockfile", lockfile, "--shared");
+    BOOST_REQUIRE(wait_for_file(wd / "first_reader.marker"));
+
+    auto second_reader = start_goldilock_holder_in(wd, "second_reader", "--lockfile", lockfile, "--shared");
+    BOOST_REQUIRE(wait_for_file(wd / "second_reader.marker"));
+
+    // the writer waits for both readers, and readers arriving after it wait for the writer
+    auto writer = start_goldilock_holder_in(wd, "writer", "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "writer.marker", 10) == false);
+
+    auto late_reader = start_goldilock_holder_in(wd, "late_reader", "--lockfile", lockfile, "--shared");
+    BOOST_REQUIRE(wait_for_file(wd / "late_reader.marker", 10) == false);
+
+    tipi::goldilock::file::touch_file(wd / "first_reader.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "writer.marker", 10) == false);
+
+    tipi::goldilock::file::touch_file(wd / "second_reader.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "writer.marker"));
+    BOOST_REQUIRE(!fs::exists(wd / "late_reader.marker"));
+
+    tipi::goldilock::file::touch_file(wd / "writer.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "late_reader.marker"));
+    tipi::goldilock::file::touch_file(wd / "late_reader.unlock");
+
+    for(auto* holder : { &first_reader, &second_reader, &writer, &late_reader }) {
+      holder->wait();
+      BOOST_REQUIRE(holder->exit_code() == 0);
+    }
+  }
+
+  #if !BOOST_OS_WINDOWS
+  BOOST_AUTO_TEST_CASE(goldilock_any_of_takes_the_free_lock) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path lockfile_a = fs::weakly_canonical(wd / "a.lock");
+    const fs::path lockfile_b = fs::weakly_canonical(wd / "b.lock");
+    const std::string any_of = lockfile_a.generic_string() + ","s + lockfile_b.generic_string();
+
+    // the markers say which lock each got
+    auto first = start_goldilock_holder_in(wd, "first", "--any-of", any_of);
+    BOOST_REQUIRE(wait_for_file(wd / "first.marker"));
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(wd / "first.marker") == lockfile_a.generic_string());
+
+    auto second = start_goldilock_holder_in(wd, "second", "--any-of", any_of);
+    BOOST_REQUIRE(wait_for_file(wd / "second.marker"));
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(wd / "second.marker") == lockfile_b.generic_string());
+
+    // both busy: wait in both lines, take whichever gets released and tell the command which one
+    std::thread t_waiter([&](){ 
+      auto result = run_goldilock_command_in(wd, "--any-of", any_of, "--", "sh", "-c", "printf %s \"$GOLDILOCK_ACQUIRED_LOCKFILE\"");
+      BOOST_REQUIRE(result.return_code == 0);
+      BOOST_REQUIRE(result.output == lockfile_b.generic_string());
+    });
+
+    BOOST_REQUIRE(wait_for_file(wd / "a.lock.0.spot"));
+    BOOST_REQUIRE(wait_for_file(wd / "b.lock.0.spot"));
+
+    tipi::goldilock::file::touch_file(wd / "second.unlock");
+    t_waiter.join();
+
+    // ...having left the other line
+    BOOST_REQUIRE(!fs::exists(wd / "a.lock.0.spot"));
+
+    tipi::goldilock::file::touch_file(wd / "first.unlock");
+
+    for(auto* holder : { &first, &second }) {
+      holder->wait();
+      BOOST_REQUIRE(holder->exit_code() == 0);
+    }
+  }
+  #endif
+
+  BOOST_AUTO_TEST_CASE(goldilock_multi_lock_request_keeps_its_place) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const fs::path write_output_dest = wd / "test.txt";
+
+    // b.lock is held and has someone waiting in line already...
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "b.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+    auto next_holder = start_goldilock_holder_in(wd, "next_holder", "--lockfile", "b.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "b.lock.0.spot"));
+
+    // ...so that whoever needs both is first in line for a.lock only, for longer than it takes to give up repeatedly
+    std::thread t_multi([&](){ 
+      auto result = run_goldilock_command_in(wd, "--multi-lock-strategy", "reshuffle", "--lockfile", "a.lock", "--lockfile", "b.lock", "--", support_app_append_to_file_bin, "-s", "M", "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+    BOOST_REQUIRE(wait_for_file(wd / "a.lock.0.spot"));
+
+    std::thread t_single([&](){ 
+      auto result = run_goldilock_command_in(wd, "--multi-lock-strategy", "reshuffle", "--lockfile", "a.lock", "--", support_app_append_to_file_bin, "-s", "S", "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+    BOOST_REQUIRE(wait_for_file(wd / "a.lock.1.spot"));
+
+    std::this_thread::sleep_for(3s);
+    BOOST_REQUIRE(!fs::exists(write_output_dest));
+
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+    BOOST_REQUIRE(wait_for_file(wd / "next_holder.marker"));
+    tipi::goldilock::file::touch_file(wd / "next_holder.unlock");
+
+    t_multi.join();
+    t_single.join();
+
+    for(auto* h : { &holder, &next_holder }) {
+      h->wait();
+      BOOST_REQUIRE(h->exit_code() == 0);
+    }
+
+    // the later single lock request didn't take a.lock while the multi-lock request was backing off
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(write_output_dest) == "MS");
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_priority_goes_ahead_until_aged) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+
+    // a low priority goldilock gets in line first, then a higher priority one (aging as given)
+    auto run_round = [&](const std::string& name, const std::string& priority_aging) {
+      const fs::path write_output_dest = wd / (name + ".txt");
+
+      auto holder = start_goldilock_holder_in(wd, name, "--lockfile", "test.lock");
+      BOOST_REQUIRE(wait_for_file(wd / (name + ".marker")));
+
+      std::thread t_low([&](){ 
+        auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--", support_app_append_to_file_bin, "-s", "L", "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+        BOOST_REQUIRE(result.return_code == 0);
+      });
+      BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+      std::this_thread::sleep_for(200ms);
+
+      std::thread t_high([&](){ 
+        auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--priority", "1", "--priority-aging", priority_aging, "--", support_app_append_to_file_bin, "-s", "H", "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+        BOOST_REQUIRE(result.return_code == 0);
+      });
+      BOOST_REQUIRE(wait_for_file(wd / "test.lock.1.spot"));
+
+      // the one first in line until now may still wait for the lock in the kernel for a moment
+      std::this_thread::sleep_for(1s);
+      tipi::goldilock::file::touch_file(wd / (name + ".unlock"));
+      t_low.join();
+      t_high.join();
+      holder.wait();
+
+      return tipi::goldilock::file::read_file_content(write_output_dest);
+    };
+
+    // worth a minute of waiting by default...
+    BOOST_REQUIRE(run_round("default_aging", "60000") == "HL");
+
+    // ...but not the 200ms the other one waited longer
+    BOOST_REQUIRE(run_round("short_aging", "100") == "LH");
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_earliest_deadline_goes_first) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const fs::path write_output_dest = wd / "test.txt";
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "test.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    auto in_seconds = [](size_t seconds) {
+      return std::to_string(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() + seconds);
+    };
+
+    // in line in this order: no deadline, a deadline in 10 minutes, a deadline in a minute
+    std::vector<std::thread> waiters;
+    for(const auto& [chr, deadline] : std::vector<std::pair<std::string, std::string>>{ { "W", "" }, { "L", in_seconds(600) }, { "E", in_seconds(60) } }) {
+      waiters.emplace_back([&, chr = chr, deadline = deadline](){ 
+        auto result = deadline.empty()
+          ? run_goldilock_command_in(wd, "--lockfile", "test.lock", "--", support_app_append_to_file_bin, "-s", chr, "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1")
+          : run_goldilock_command_in(wd, "--lockfile", "test.lock", "--deadline", deadline, "--", support_app_append_to_file_bin, "-s", chr, "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+        BOOST_REQUIRE(result.return_code == 0);
+      });
+      BOOST_REQUIRE(wait_for_file(wd / ("test.lock."s + std::to_string(waiters.size() - 1) + ".spot"s)));
+    }
+
+    // the one first in line until now may still wait for the lock in the kernel for a moment
+    std::this_thread::sleep_for(1s);
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+
+    for(auto& waiter : waiters) {
+      waiter.join();
+    }
+    holder.wait();
+
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(write_output_dest) == "ELW");
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_tenants_take_turns) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const fs::path write_output_dest = wd / "test.txt";
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "test.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    // tenant a queues up first with several goldilocks, tenant b comes later
+    std::vector<std::thread> waiters;
+    for(const auto& tenant : { "a", "a", "a", "b" }) {
+      waiters.emplace_back([&, tenant](){ 
+        auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--tenant", tenant, "--fair-share", "1", "--", support_app_append_to_file_bin, "-s", tenant, "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+        BOOST_REQUIRE(result.return_code == 0);
+      });
+      BOOST_REQUIRE(wait_for_file(wd / ("test.lock."s + std::to_string(waiters.size() - 1) + ".spot"s)));
+    }
+
+    // the one first in line until now may still wait for the lock in the kernel for a moment
+    std::this_thread::sleep_for(1s);
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+
+    for(auto& waiter : waiters) {
+      waiter.join();
+    }
+    holder.wait();
+
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(write_output_dest) == "abaa");
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_refuses_to_get_in_long_lines) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "test.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    std::thread t_waiter([&](){
+      auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+
+    // one in line already
+    auto too_deep = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--max-queue-depth", "1", "--", "echo", "done");
+    BOOST_REQUIRE(too_deep.return_code == 75);
+
+    // previous holders took a minute each
+    tipi::goldilock::file::write_file_permissive(wd / "test.lock.hold-time", "60000");
+    auto too_long = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--max-expected-wait", "1000", "--", "echo", "done");
+    BOOST_REQUIRE(too_long.return_code == 75);
+
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+    t_waiter.join();
+    holder.wait();
+
+    // nobody in line anymore, and the holders told how long they actually held the lock
+    auto admitted = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--max-queue-depth", "1", "--max-expected-wait", "1000", "--", "echo", "done");
+    BOOST_REQUIRE(admitted.return_code == 0);
+    BOOST_REQUIRE(std::stoull(tipi::goldilock::file::read_file_content(wd / "test.lock.hold-time")) < 60000);
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_refuses_long_expected_waits) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const fs::path write_output_dest = wd / "test.txt";
+
+    // a previous holder took about two seconds
+    auto recorded = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--", support_app_append_to_file_bin, "-s", "r", "-n", "20", "-f", write_output_dest.generic_string(), "-i", "100");
+    BOOST_REQUIRE(recorded.return_code == 0);
+    BOOST_REQUIRE(std::stoull(tipi::goldilock::file::read_file_content(wd / "test.lock.hold-time")) >= 2000);
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "test.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    std::thread t_waiter([&](){
+      auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.0.spot"));
+
+    // two seconds for the one in line are too long to wait, without leaving a spot behind...
+    auto too_long = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--max-expected-wait", "1000", "--", "echo", "done");
+    BOOST_REQUIRE(too_long.return_code == 75);
+    BOOST_REQUIRE(!fs::exists(wd / "test.lock.1.spot"));
+
+    // ...but not with a little more patience
+    std::thread t_patient([&](){
+      auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--max-expected-wait", "10000", "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+    BOOST_REQUIRE(wait_for_file(wd / "test.lock.1.spot"));
+
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+    t_waiter.join();
+    t_patient.join();
+    holder.wait();
+    BOOST_REQUIRE(holder.exit_code() == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_gives_up_waiting_cleanly) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "b.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    auto tried = run_goldilock_command_in(wd, "--try", "--lockfile", "b.lock", "--", "echo", "done");
+    BOOST_REQUIRE(tried.return_code == 124);
+
+    // gets a.lock, then waits for b.lock in vain
+    auto timed_out = run_goldilock_command_in(wd, "--acquire-timeout", "1000", "--lockfile", "a.lock", "--lockfile", "b.lock", "--", "echo", "done");
+    BOOST_REQUIRE(timed_out.return_code == 124);
+
+    // nothing left behind: no spots in line and a.lock is free again
+    BOOST_REQUIRE(!fs::exists(wd / "a.lock.0.spot"));
+    BOOST_REQUIRE(!fs::exists(wd / "b.lock.0.spot"));
+    auto free_again = run_goldilock_command_in(wd, "--try", "--lockfile", "a.lock", "--", "echo", "done");
+    BOOST_REQUIRE(free_again.return_code == 0);
+
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+    holder.wait();
+    BOOST_REQUIRE(holder.exit_code() == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_deep_line_drains_in_order) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const fs::path write_output_dest = wd / "test.txt";
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--lockfile", "test.lock");
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    std::vector<std::thread> waiters;
+    for(const auto& chr : { "a", "b", "c", "d", "e", "f", "g", "h" }) {
+      waiters.emplace_back([&, chr](){
+        auto result = run_goldilock_command_in(wd, "--lockfile", "test.lock", "--", support_app_append_to_file_bin, "-s", chr, "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+        BOOST_REQUIRE(result.return_code == 0);
+      });
+      BOOST_REQUIRE(wait_for_file(wd / ("test.lock."s + std::to_string(waiters.size() - 1) + ".spot"s)));
+    }
+
+    // long enough for those far back to look at the line only every now and then
+    std::this_thread::sleep_for(5s);
+
+    auto released_at = std::chrono::steady_clock::now();
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+
+    for(auto& waiter : waiters) {
+      waiter.join();
+    }
+    holder.wait();
+
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(write_output_dest) == "abcdefgh");
+    BOOST_REQUIRE(std::chrono::steady_clock::now() - released_at < 20s);
+  }
+
+  #if BOOST_OS_LINUX
+  static auto TEST_DATA_goldilock_same_host_backends = { "shm", "socket" };
+
+  BOOST_DATA_TEST_CASE(goldilock_same_host_backends, 
+    boost::unit_test::data::make(TEST_DATA_goldilock_same_host_backends), 
+    backend
+  ) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const std::string lockfile = (wd / "test.lock").generic_string();
+    const std::string waiter_locked_marker = (wd / "waiter_locked.marker").generic_string();
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--backend", backend, "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    std::thread t_waiter([&](){ 
+      auto result = run_goldilock_command_in(wd, "--backend", backend, "--lockfile", lockfile, "--lock-success-marker", waiter_locked_marker, "--", "echo", "done");
+      BOOST_REQUIRE(result.return_code == 0);
+    });
+
+    BOOST_REQUIRE(wait_for_file(waiter_locked_marker, 10) == false);
+
+    // nothing on disk, and a dead holder hands over the lock right away
+    BOOST_REQUIRE(!fs::exists(wd / "test.lock"));
+    kill(holder.native_handle(), SIGKILL);
+    holder.wait();
+
+    BOOST_REQUIRE(wait_for_file(waiter_locked_marker));
+    t_waiter.join();
+  }
+
+  BOOST_AUTO_TEST_CASE(goldilock_shm_keeps_fifo_for_long_waits) {
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const fs::path write_output_dest = wd / "test.txt";
+    const std::string lockfile = (wd / "test.lock").generic_string();
+
+    auto holder = start_goldilock_holder_in(wd, "holder", "--backend", "shm", "--lockfile", lockfile);
+    BOOST_REQUIRE(wait_for_file(wd / "holder.marker"));
+
+    // nothing to see of the line on disk: give each one time to get in the kernel's queue before the next
+    std::vector<std::thread> waiters;
+    for(const auto& chr : { "a", "b", "c", "d" }) {
+      waiters.emplace_back([&, chr](){
+        auto result = run_goldilock_command_in(wd, "--backend", "shm", "--lockfile", lockfile, "--", support_app_append_to_file_bin, "-s", chr, "-n", "1", "-f", write_output_dest.generic_string(), "-i", "1");
+        BOOST_REQUIRE(result.return_code == 0);
+      });
+      std::this_thread::sleep_for(500ms);
+    }
+
+    // everyone waited well over a second
+    std::this_thread::sleep_for(2s);
+    tipi::goldilock::file::touch_file(wd / "holder.unlock");
+
+    for(auto& waiter : waiters) {
+      waiter.join();
+    }
+    holder.wait();
+
+    BOOST_REQUIRE(tipi::goldilock::file::read_file_content(write_output_dest) == "abcd");
+  }
+  #endif
+
   static auto TEST_DATA_goldilock_lock_watch_parent_process__search_nearest = { true, false };
 
   BOOST_DATA_TEST_CASE(
@@ -17,6 +17,9 @@
 #include <boost/uuid/random_generator.hpp>
 #include <boost/scope_exit.hpp>
 #include <boost/thread.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/string.hpp>
 
 #include <test_helpers.hpp>
 #include <iostream>
@@ -26,6 +29,8 @@
 #include <thread>
 
 #include <goldilock/file.hpp>
+#include <goldilock/goldilock_spot.hpp>
+#include <goldilock/lock_backends.hpp>
 #include <goldilock/process_info.hpp>
 
  
@@ -144,4 +149,230 @@ namespace goldilock::test {
 
 
   }
+
+  // the same workload through every --backend: uncontended runs one after the other, then a crowd of
+  // goldilocks started at once on the same lockfile
+  BOOST_AUTO_TEST_CASE(lock_backends_side_by_side) {
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const size_t sequential_runs = 20;
+    const size_t concurrent_runs = std::max<size_t>(std::thread::hardware_concurrency(), 4) * 2;
+
+    std::vector<std::string> report;
+
+    for(const auto& backend : tipi::goldilock::available_lock_backends()) {
+      auto wd = get_goldilock_case_working_dir();
+      fs::create_directories(wd);
+
+      const fs::path write_output_dest = wd / "test.txt";
+      const std::string lockfile = (wd / "lockfile").generic_string();
+
+      auto start_goldilock = [&](size_t task_ix) {
+        return bp::child(
+          host_goldilock_executable_path(), "--backend", backend, "--lockfile", lockfile, "--", support_app_append_to_file_bin, "-s", std::to_string(task_ix) + ":"s, "-n", "3", "-f", write_output_dest.generic_string(), "-i", "1",
+          bp::start_dir=wd, bp::std_out > bp::null, bp::std_err > bp::null, bp::std_in < bp::null
+        );
+      };
+
+      auto sequential_start = std::chrono::steady_clock::now();
+
+      for(size_t task_ix = 0; task_ix < sequential_runs; task_ix++) {
+        auto child = start_goldilock(task_ix);
+        child.wait();
+        BOOST_REQUIRE(child.exit_code() == 0);
+      }
+
+      std::chrono::duration<double, std::milli> sequential_elapsed = std::chrono::steady_clock::now() - sequential_start;
+
+      auto concurrent_start = std::chrono::steady_clock::now();
+
+      std::vector<bp::child> child_processes;
+      for(size_t task_ix = sequential_runs; task_ix < sequential_runs + concurrent_runs; task_ix++) {
+        child_processes.push_back(start_goldilock(task_ix));
+      }
+
+      for(auto& child : child_processes) {
+        child.wait();
+        BOOST_REQUIRE(child.exit_code() == 0);
+      }
+
+      std::chrono::duration<double, std::milli> concurrent_elapsed = std::chrono::steady_clock::now() - concurrent_start;
+
+      auto file_content = tipi::goldilock::file::read_file_content(write_output_dest);
+      for(size_t task_ix = 0; task_ix < sequential_runs + concurrent_runs; task_ix++) {
+        BOOST_REQUIRE(boost::regex_search(file_content, boost::regex{"(("s + std::to_string(task_ix) + ":){3})"s}));
+      }
+
+      std::ostringstream line;
+      line << backend << ": " << sequential_elapsed.count() / sequential_runs << "ms per uncontended run, "
+        << concurrent_elapsed.count() << "ms for " << concurrent_runs << " concurrent runs (" << concurrent_elapsed.count() / concurrent_runs << "ms per handoff)";
+      report.push_back(line.str());
+    }
+
+    std::cout << "Lock backends side by side:" << std::endl;
+    for(const auto& line : report) {
+      std::cout << "  " << line << std::endl;
+    }
+  }
+
+  // the goldilocked_write_multiple_lockfiles setup (overlapping sets of lockfiles, all released at
+  // once by a master holding them all) scaled up and run with every --multi-lock-strategy
+  BOOST_AUTO_TEST_CASE(multi_lock_strategies_side_by_side) {
+
+    const fs::path support_app_append_to_file_bin = get_executable_path_from_test_env("support_app_append_to_file");
+    const size_t rounds = 4;
+
+    std::vector<std::string> report;
+
+    for(const std::string strategy : { "ordered", "reshuffle" }) {
+      auto wd = get_goldilock_case_working_dir();
+      fs::create_directories(wd);
+
+      const fs::path write_output_dest = wd / "test.txt";
+      const std::string master_unlockfile = (wd / "master_unlockfile").generic_string();
+      const std::string master_all_locks_acquired = (wd / "master_locked.marker").generic_string();
+      const std::string gl_A_lockfile = (wd / "lockfile_A").generic_string();
+      const std::string gl_B_lockfile = (wd / "lockfile_B").generic_string();
+      const std::string gl_C_lockfile = (wd / "lockfile_C").generic_string();
+      const std::string gl_D_lockfile = (wd / "lockfile_D").generic_string();
+
+      // all of them use lockfile_B so that none write test.txt at the same time
+      const std::vector<std::vector<std::string>> lock_sets = {
+        { gl_A_lockfile, gl_B_lockfile, gl_C_lockfile },
+        { gl_C_lockfile, gl_B_lockfile },
+        { gl_D_lockfile, gl_B_lockfile },
+        { gl_D_lockfile, gl_C_lockfile, gl_B_lockfile, gl_A_lockfile },
+      };
+
+      bp::child master{
+        host_goldilock_executable_path(), "--multi-lock-strategy", strategy, "--lockfile", gl_A_lockfile, "--lockfile", gl_B_lockfile, "--lockfile", gl_C_lockfile, "--lockfile", gl_D_lockfile, "--unlockfile", master_unlockfile, "--lock-success-marker", master_all_locks_acquired,
+        bp::start_dir=wd, bp::std_out > bp::null, bp::std_err > bp::null, bp::std_in < bp::null
+      };
+
+      BOOST_REQUIRE(wait_for_file(master_all_locks_acquired));
+
+      std::vector<bp::child> child_processes;
+      const size_t tasks_expected = rounds * lock_sets.size();
+
+      for(size_t task_ix = 0; task_ix < tasks_expected; task_ix++) {
+        std::vector<std::string> args = { "--multi-lock-strategy", strategy };
+        for(const auto& lockfile : lock_sets[task_ix % lock_sets.size()]) {
+          args.push_back("--lockfile");
+          args.push_back(lockfile);
+        }
+
+        args.insert(args.end(), { "--", support_app_append_to_file_bin.generic_string(), "-s", std::to_string(task_ix) + ":"s, "-n", "5", "-f", write_output_dest.generic_string(), "-i", "1" });
+
+        child_processes.emplace_back(
+          host_goldilock_executable_path(), bp::args(args),
+          bp::start_dir=wd, bp::std_out > bp::null, bp::std_err > bp::null, bp::std_in < bp::null
+        );
+      }
+
+      // let them all get in line
+      std::this_thread::sleep_for(1s);
+
+      auto bench_start = std::chrono::steady_clock::now();
+      tipi::goldilock::file::touch_file_permissive(master_unlockfile);
+
+      for(auto& child : child_processes) {
+        child.wait();
+        BOOST_REQUIRE(child.exit_code() == 0);
+      }
+
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - bench_start;
+      master.wait();
+
+      auto file_content = tipi::goldilock::file::read_file_content(write_output_dest);
+      for(size_t task_ix = 0; task_ix < tasks_expected; task_ix++) {
+        BOOST_REQUIRE(boost::regex_search(file_content, boost::regex{"(("s + std::to_string(task_ix) + ":){5})"s}));
+      }
+
+      std::ostringstream line;
+      line << strategy << ": " << elapsed.count() << "ms for " << tasks_expected << " goldilocks on overlapping lockfiles";
+      report.push_back(line.str());
+    }
+
+    std::cout << "Multi lock strategies side by side:" << std::endl;
+    for(const auto& line : report) {
+      std::cout << "  " << line << std::endl;
+    }
+  }
+
+  // mirrors the legacy goldilock_spot text archive layout
+  struct legacy_spot_fields {
+    size_t timestamp_ = 0;
+    std::string guid_;
+
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int version) {
+      ar &timestamp_;
+      ar &guid_;
+    }
+  };
+
+  BOOST_AUTO_TEST_CASE(spot_parse_cost) {
+
+    auto wd = get_goldilock_case_working_dir();
+    fs::create_directories(wd);
+
+    const size_t spot_count = 10000;
+    const fs::path lockfile = wd / "bench.lock";
+
+    // a real spot in line gives us a binary record, the legacy text archive is produced by
+    // boost::serialization the same way older goldilock versions did
+    tipi::goldilock::goldilock_spot spot(lockfile);
+    const std::string binary_raw = tipi::goldilock::file::read_file_content(spot.get_spot_path());
+
+    // the legacy text archive only has whole seconds
+    const size_t timestamp_ms = spot.get_timestamp();
+    const size_t legacy_timestamp_ms = timestamp_ms / 1000 * 1000;
+
+    std::string legacy_raw;
+    {
+      legacy_spot_fields fields{ legacy_timestamp_ms / 1000, spot.get_guid() };
+      std::ostringstream oss;
+      boost::archive::text_oarchive oa(oss);
+      oa << fields;
+      legacy_raw = oss.str();
+    }
+
+    auto measure_per_spot_us = [&](size_t expected_timestamp, auto&& parse_fn) {
+      auto start = std::chrono::steady_clock::now();
+
+      for(size_t ix = 0; ix < spot_count; ix++) {
+        BOOST_REQUIRE(parse_fn() == expected_timestamp);
+      }
+
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      return elapsed.count() / spot_count;
+    };
+
+    auto binary_us = measure_per_spot_us(timestamp_ms, [&]() {
+      auto record = tipi::goldilock::spot_record::decode(reinterpret_cast<const unsigned char *>(binary_raw.data()), binary_raw.size());
+      return record.value().timestamp;
+    });
+
+    auto legacy_us = measure_per_spot_us(legacy_timestamp_ms / 1000, [&]() {
+      legacy_spot_fields fields;
+      std::istringstream iss(legacy_raw);
+      boost::archive::text_iarchive ia(iss);
+      ia >> fields;
+      return fields.timestamp_;
+    });
+
+    std::cout << "Spot parse cost - binary record: " << binary_us << "us, legacy text archive: " << legacy_us << "us (per spot, " << spot_count << " spots)" << std::endl;
+
+    // ...and the whole way through goldilock_spot::read_from() including the file access
+    const fs::path legacy_spot_path = wd / "legacy.lock.1";
+    {
+      std::ofstream ofs(legacy_spot_path.generic_string());
+      ofs << legacy_raw;
+    }
+
+    auto binary_read_us = measure_per_spot_us(timestamp_ms, [&]() { return tipi::goldilock::goldilock_spot::read_from(spot.get_spot_path(), lockfile).get_timestamp(); });
+    auto legacy_read_us = measure_per_spot_us(legacy_timestamp_ms, [&]() { return tipi::goldilock::goldilock_spot::read_from(legacy_spot_path, wd / "legacy.lock").get_timestamp(); });
+
+    std::cout << "Spot read_from() cost - binary record: " << binary_read_us << "us, legacy text archive: " << legacy_read_us << "us" << std::endl;
+  }
 }
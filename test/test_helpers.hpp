@@ -168,6 +168,18 @@ namespace goldilock::test {
     return result;
   }
 
+  //!\brief start a goldilock with the given arguments holding its lock(s) until `<name>.unlock` is touched in the working directory.
+  //! `<name>.marker` appears there once it got the lock(s)
+  template <class... Param>
+  inline bp::child start_goldilock_holder_in(const fs::path& working_directory, const std::string& name, Param &&... args) {
+    return bp::child{
+      host_goldilock_executable_path(), std::forward<Param>(args)...,
+      "--unlockfile", (working_directory / (name + ".unlock")).generic_string(), "--no-timeout",
+      "--lock-success-marker", (working_directory / (name + ".marker")).generic_string(),
+      bp::start_dir=working_directory, bp::std_out > bp::null, bp::std_err > bp::null
+    };
+  }
+
   //!\brief wait for a file to apear
   inline bool wait_for_file(const fs::path& path, size_t retries = 50, std::chrono::milliseconds retry_interval = 50ms) {
     bool found_file = false;